@@ -0,0 +1,68 @@
+#include "InflightRequests.h"
+#include "VtkPlugin.h"
+
+namespace OrthancPlugins {
+
+    InflightRequests::Meshes InflightRequests::Get(const std::string& key,
+                                                   const Generator& generator)
+    {
+        std::shared_ptr<Flight> flight;
+
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+
+            Flights::iterator found = flights_.find(key);
+            if (found != flights_.end())
+            {
+                // Follower: wait for the leader of this key
+                flight = found->second;
+                while (!flight->done_)
+                {
+                    finished_.wait(lock);
+                }
+
+                if (flight->error_ != OrthancPluginErrorCode_Success)
+                {
+                    throw PluginException(flight->error_);
+                }
+
+                return flight->result_;
+            }
+
+            flight.reset(new Flight);
+            flights_[key] = flight;
+        }
+
+        Meshes result;
+        OrthancPluginErrorCode error = OrthancPluginErrorCode_Success;
+
+        try
+        {
+            result = generator();
+        }
+        catch (PluginException& e)
+        {
+            error = e.GetErrorCode();
+        }
+        catch (...)
+        {
+            error = OrthancPluginErrorCode_InternalError;
+        }
+
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            flight->done_ = true;
+            flight->result_ = result;
+            flight->error_ = error;
+            flights_.erase(key);
+            finished_.notify_all();
+        }
+
+        if (error != OrthancPluginErrorCode_Success)
+        {
+            throw PluginException(error);
+        }
+
+        return result;
+    }
+}
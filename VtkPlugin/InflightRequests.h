@@ -0,0 +1,55 @@
+#ifndef VTKPLUGIN_INFLIGHTREQUESTS_H
+#define VTKPLUGIN_INFLIGHTREQUESTS_H
+
+#include "MeshCache.h"
+#include "OrthancCPlugin.h"
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace OrthancPlugins {
+
+    /**
+     * Table of the meshes being generated right now. The first request for
+     * a key runs the generator; concurrent requests for the same key wait
+     * for its result (or its error) instead of redoing the work. A result
+     * holds every mesh the generation yields, such as all the levels of a
+     * pyramid, so that requests for any of them share it.
+     **/
+    class InflightRequests : public boost::noncopyable
+    {
+    public:
+        typedef std::vector<CachedMeshPointer>      Meshes;
+        typedef std::function<Meshes()>             Generator;
+
+    private:
+        struct Flight
+        {
+            bool                    done_;
+            Meshes                  result_;
+            OrthancPluginErrorCode  error_;
+
+            Flight() :
+                    done_(false),
+                    error_(OrthancPluginErrorCode_Success)
+            {
+            }
+        };
+
+        typedef std::map<std::string, std::shared_ptr<Flight> >  Flights;
+
+        boost::mutex               mutex_;
+        boost::condition_variable  finished_;
+        Flights                    flights_;
+
+    public:
+        Meshes Get(const std::string& key,
+                   const Generator& generator);
+    };
+}
+
+#endif
@@ -0,0 +1,272 @@
+#include "JobScheduler.h"
+#include <cmath>
+
+namespace OrthancPlugins {
+
+    static const char* EnumerationToString(JobState state)
+    {
+        switch (state)
+        {
+            case JobState_Pending:
+                return "Pending";
+
+            case JobState_Running:
+                return "Running";
+
+            case JobState_Success:
+                return "Success";
+
+            case JobState_Failure:
+                return "Failure";
+
+            default:
+                throw PluginException(OrthancPluginErrorCode_ParameterOutOfRange);
+        }
+    }
+
+
+    size_t JobScheduler::GetResultSize(const Job& job)
+    {
+        return (job.result_ ? job.result_->content.size() : 0);
+    }
+
+
+    JobScheduler::JobScheduler(const Handler& handler) :
+            handler_(handler),
+            context_(NULL),
+            maxPendingJobs_(0),
+            maxCompletedJobs_(0),
+            maxCompletedSize_(0),
+            completedSize_(0),
+            stopped_(true)
+    {
+    }
+
+
+    JobScheduler::~JobScheduler()
+    {
+        Stop();
+    }
+
+
+    void JobScheduler::Start(OrthancPluginContext* context,
+                             unsigned int maxConcurrentJobs,
+                             size_t maxPendingJobs,
+                             size_t maxCompletedJobs,
+                             size_t maxCompletedSize)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        if (!stopped_)
+        {
+            return;
+        }
+
+        context_ = context;
+        maxPendingJobs_ = maxPendingJobs;
+        maxCompletedJobs_ = (maxCompletedJobs == 0 ? 1 : maxCompletedJobs);
+        maxCompletedSize_ = maxCompletedSize;
+        stopped_ = false;
+
+        for (unsigned int i = 0; i < (maxConcurrentJobs == 0 ? 1 : maxConcurrentJobs); i++)
+        {
+            workers_.create_thread([this]() { Worker(); });
+        }
+    }
+
+
+    void JobScheduler::Stop()
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            stopped_ = true;
+            available_.notify_all();
+        }
+
+        workers_.join_all();
+    }
+
+
+    bool JobScheduler::Submit(std::string& id,
+                              const MeshJobParameters& parameters)
+    {
+        std::shared_ptr<Job> job(new Job);
+        job->parameters_ = parameters;
+        job->state_ = JobState_Pending;
+        job->error_ = OrthancPluginErrorCode_Success;
+
+        boost::mutex::scoped_lock lock(mutex_);
+
+        if (stopped_)
+        {
+            throw PluginException(OrthancPluginErrorCode_BadSequenceOfCalls);
+        }
+
+        if (maxPendingJobs_ != 0 &&
+            pending_.size() >= maxPendingJobs_)
+        {
+            return false;
+        }
+
+        {
+            char* tmp = OrthancPluginGenerateUuid(context_);
+            if (tmp == NULL)
+            {
+                throw PluginException(OrthancPluginErrorCode_InternalError);
+            }
+
+            id.assign(tmp);
+            OrthancPluginFreeString(context_, tmp);
+        }
+
+        jobs_[id] = job;
+        pending_.push_back(id);
+        available_.notify_one();
+
+        return true;
+    }
+
+
+    bool JobScheduler::GetStatus(Json::Value& target,
+                                 const std::string& id)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        Jobs::const_iterator found = jobs_.find(id);
+        if (found == jobs_.end())
+        {
+            return false;
+        }
+
+        const Job& job = *found->second;
+
+        target = Json::objectValue;
+        target["ID"] = id;
+        target["State"] = EnumerationToString(job.state_);
+        target["StudyInstanceUID"] = job.parameters_.studyUid;
+        target["SeriesInstanceUID"] = job.parameters_.seriesUid;
+        target["ContentType"] = job.parameters_.options.contentType;
+
+        if (job.parameters_.options.targetTriangles != 0)
+        {
+            target["TargetTriangles"] = static_cast<Json::UInt64>(job.parameters_.options.targetTriangles);
+        }
+        else if (job.parameters_.options.reduction > 0)
+        {
+            target["Reduction"] = job.parameters_.options.reduction;
+        }
+        else if (job.parameters_.options.pyramid)
+        {
+            target["LevelOfDetail"] = job.parameters_.options.lod;
+        }
+
+        if (!job.parameters_.options.ranges.empty())
+        {
+            // Jobs mesh a single range, whose upper bound may be unbounded
+            const ThresholdRange& range = job.parameters_.options.ranges[0];
+            target["Threshold"] = Json::arrayValue;
+            target["Threshold"].append(range.lower);
+            target["Threshold"].append(std::isinf(range.upper) ? Json::Value() : Json::Value(range.upper));
+        }
+
+        if (job.state_ == JobState_Success)
+        {
+            target["Result"] = "/vtk/jobs/" + id + "/result";
+            target["Size"] = static_cast<Json::UInt64>(job.result_->content.size());
+        }
+        else if (job.state_ == JobState_Failure)
+        {
+            target["ErrorCode"] = static_cast<int>(job.error_);
+            target["ErrorDescription"] = OrthancPluginGetErrorDescription(context_, job.error_);
+        }
+
+        return true;
+    }
+
+
+    bool JobScheduler::GetResult(JobState& state,
+                                 OrthancPluginErrorCode& error,
+                                 CachedMeshPointer& result,
+                                 const std::string& id)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        Jobs::const_iterator found = jobs_.find(id);
+        if (found == jobs_.end())
+        {
+            return false;
+        }
+
+        state = found->second->state_;
+        error = found->second->error_;
+        result = found->second->result_;
+        return true;
+    }
+
+
+    void JobScheduler::Worker()
+    {
+        for (;;)
+        {
+            std::string id;
+            std::shared_ptr<Job> job;
+
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+
+                while (pending_.empty() && !stopped_)
+                {
+                    available_.wait(lock);
+                }
+
+                if (stopped_)
+                {
+                    return;
+                }
+
+                id = pending_.front();
+                pending_.pop_front();
+
+                job = jobs_[id];
+                job->state_ = JobState_Running;
+            }
+
+            CachedMeshPointer result;
+            OrthancPluginErrorCode error = OrthancPluginErrorCode_Success;
+
+            try
+            {
+                result = handler_(job->parameters_);
+            }
+            catch (PluginException& e)
+            {
+                error = e.GetErrorCode();
+            }
+            catch (...)
+            {
+                error = OrthancPluginErrorCode_InternalError;
+            }
+
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+
+                job->state_ = (error == OrthancPluginErrorCode_Success ? JobState_Success : JobState_Failure);
+                job->error_ = error;
+                job->result_ = result;
+
+                completed_.push_back(id);
+                completedSize_ += GetResultSize(*job);
+
+                // The last job is kept even if its result alone is over the budget
+                while (completed_.size() > maxCompletedJobs_ ||
+                       (completed_.size() > 1 && completedSize_ > maxCompletedSize_))
+                {
+                    Jobs::iterator oldest = jobs_.find(completed_.front());
+                    completedSize_ -= GetResultSize(*oldest->second);
+                    jobs_.erase(oldest);
+                    completed_.pop_front();
+                }
+            }
+        }
+    }
+}
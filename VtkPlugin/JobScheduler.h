@@ -0,0 +1,102 @@
+#ifndef VTKPLUGIN_JOBSCHEDULER_H
+#define VTKPLUGIN_JOBSCHEDULER_H
+
+#include "VtkPlugin.h"
+#include "MeshCache.h"
+#include "MeshOptions.h"
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace OrthancPlugins {
+
+    enum JobState
+    {
+        JobState_Pending,
+        JobState_Running,
+        JobState_Success,
+        JobState_Failure
+    };
+
+    struct MeshJobParameters
+    {
+        std::string  seriesId;      // Orthanc identifier of the series
+        std::string  studyUid;
+        std::string  seriesUid;
+        MeshOptions  options;
+    };
+
+    /**
+     * Runs mesh generation jobs submitted through the REST API on a fixed
+     * number of worker threads, so that heavy meshing never holds one of
+     * the HTTP threads of Orthanc. Submissions are refused once too many
+     * jobs are waiting. Only the most recent finished jobs are remembered,
+     * within a budget of bytes for their results.
+     **/
+    class JobScheduler : public boost::noncopyable
+    {
+    public:
+        typedef std::function<CachedMeshPointer(const MeshJobParameters&)>  Handler;
+
+    private:
+        struct Job
+        {
+            MeshJobParameters       parameters_;
+            JobState                state_;
+            OrthancPluginErrorCode  error_;
+            CachedMeshPointer       result_;
+        };
+
+        typedef std::map<std::string, std::shared_ptr<Job> >  Jobs;
+
+        Handler                    handler_;
+        OrthancPluginContext*      context_;
+        boost::mutex               mutex_;
+        boost::condition_variable  available_;
+        Jobs                       jobs_;
+        std::deque<std::string>    pending_;
+        std::deque<std::string>    completed_;
+        size_t                     maxPendingJobs_;
+        size_t                     maxCompletedJobs_;
+        size_t                     maxCompletedSize_;
+        size_t                     completedSize_;
+        bool                       stopped_;
+        boost::thread_group        workers_;
+
+        static size_t GetResultSize(const Job& job);
+
+        void Worker();
+
+    public:
+        explicit JobScheduler(const Handler& handler);
+
+        ~JobScheduler();
+
+        // A "maxPendingJobs" of 0 accepts any number of waiting jobs
+        void Start(OrthancPluginContext* context,
+                   unsigned int maxConcurrentJobs,
+                   size_t maxPendingJobs,
+                   size_t maxCompletedJobs,
+                   size_t maxCompletedSize);
+
+        void Stop();
+
+        // Returns false if too many jobs are already waiting
+        bool Submit(std::string& id,
+                    const MeshJobParameters& parameters);
+
+        bool GetStatus(Json::Value& target,
+                       const std::string& id);
+
+        bool GetResult(JobState& state,
+                       OrthancPluginErrorCode& error,
+                       CachedMeshPointer& result,
+                       const std::string& id);
+    };
+}
+
+#endif
@@ -0,0 +1,95 @@
+#include "MeshCache.h"
+
+namespace OrthancPlugins {
+
+    MeshCache::MeshCache(size_t maximumSize) :
+            maximumSize_(maximumSize),
+            currentSize_(0)
+    {
+    }
+
+
+    void MeshCache::Remove(Index::iterator it)
+    {
+        currentSize_ -= it->second->second->content.size();
+        queue_.erase(it->second);
+        index_.erase(it);
+    }
+
+
+    void MeshCache::SetMaximumSize(size_t maximumSize)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        maximumSize_ = maximumSize;
+
+        while (currentSize_ > maximumSize_)
+        {
+            Remove(index_.find(queue_.back().first));
+        }
+    }
+
+
+    bool MeshCache::IsEnabled()
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        return maximumSize_ > 0;
+    }
+
+
+    bool MeshCache::Lookup(CachedMeshPointer& mesh,
+                           const std::string& key)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        Index::iterator found = index_.find(key);
+        if (found == index_.end())
+        {
+            return false;
+        }
+
+        // Move the entry to the front of the LRU queue, iterators stay valid
+        queue_.splice(queue_.begin(), queue_, found->second);
+        mesh = found->second->second;
+        return true;
+    }
+
+
+    void MeshCache::Store(const std::string& key,
+                          const CachedMeshPointer& mesh)
+    {
+        const size_t size = mesh->content.size();
+
+        boost::mutex::scoped_lock lock(mutex_);
+
+        Index::iterator found = index_.find(key);
+        if (found != index_.end())
+        {
+            Remove(found);
+        }
+
+        if (size > maximumSize_)
+        {
+            // Would evict the whole cache and still not fit
+            return;
+        }
+
+        while (currentSize_ + size > maximumSize_)
+        {
+            Remove(index_.find(queue_.back().first));
+        }
+
+        queue_.push_front(Entry(key, mesh));
+        index_[key] = queue_.begin();
+        currentSize_ += size;
+    }
+
+
+    std::string MeshCache::GetKey(const std::string& studyUid,
+                                  const std::string& seriesUid,
+                                  const std::string& instancesHash,
+                                  const std::string& parameters)
+    {
+        return studyUid + "|" + seriesUid + "|" + instancesHash + "|" + parameters;
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef VTKPLUGIN_MESHCACHE_H
+#define VTKPLUGIN_MESHCACHE_H
+
+#include "MeshEncoding.h"
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace OrthancPlugins {
+
+    struct CachedMesh
+    {
+        std::string      content;
+        std::string      contentType;
+        ContentEncoding  contentEncoding;
+
+        CachedMesh() : contentEncoding(ContentEncoding_Identity)
+        {
+        }
+    };
+
+    typedef std::shared_ptr<const CachedMesh>  CachedMeshPointer;
+
+    /**
+     * In-memory cache of serialized meshes, bounded by the total size of
+     * their content and evicted in least-recently-used order. Lookups and
+     * insertions are O(1). Entries are shared, so an answer that is being
+     * sent survives its eviction.
+     **/
+    class MeshCache : public boost::noncopyable
+    {
+    private:
+        typedef std::pair<std::string, CachedMeshPointer>    Entry;
+        typedef std::list<Entry>                             Queue;  // Most recently used first
+        typedef std::unordered_map<std::string, Queue::iterator>  Index;
+
+        boost::mutex  mutex_;
+        Queue         queue_;
+        Index         index_;
+        size_t        maximumSize_;
+        size_t        currentSize_;
+
+        void Remove(Index::iterator it);
+
+    public:
+        explicit MeshCache(size_t maximumSize);
+
+        void SetMaximumSize(size_t maximumSize);
+
+        bool IsEnabled();
+
+        bool Lookup(CachedMeshPointer& mesh,
+                    const std::string& key);
+
+        void Store(const std::string& key,
+                   const CachedMeshPointer& mesh);
+
+        static std::string GetKey(const std::string& studyUid,
+                                  const std::string& seriesUid,
+                                  const std::string& instancesHash,
+                                  const std::string& parameters);
+    };
+}
+
+#endif
@@ -0,0 +1,211 @@
+#include "MeshEncoding.h"
+#include "VtkPlugin.h"
+#include <cstdlib>
+#include <vector>
+
+namespace OrthancPlugins {
+
+    const char* EnumerationToString(ContentEncoding encoding)
+    {
+        switch (encoding)
+        {
+            case ContentEncoding_Identity:
+                return "identity";
+
+            case ContentEncoding_Gzip:
+                return "gzip";
+
+            case ContentEncoding_Deflate:
+                return "deflate";
+
+            default:
+                throw PluginException(OrthancPluginErrorCode_ParameterOutOfRange);
+        }
+    }
+
+
+    bool LookupContentEncoding(ContentEncoding& target,
+                               const std::string& token)
+    {
+        std::string s = StripSpaces(token);
+        ToLowerCase(s);
+
+        if (s == "identity")
+        {
+            target = ContentEncoding_Identity;
+        }
+        else if (s == "gzip" || s == "x-gzip")
+        {
+            target = ContentEncoding_Gzip;
+        }
+        else if (s == "deflate")
+        {
+            target = ContentEncoding_Deflate;
+        }
+        else
+        {
+            return false;
+        }
+
+        return true;
+    }
+
+
+    bool NegotiateContentEncoding(ContentEncoding& target,
+                                  const std::string& acceptEncoding,
+                                  ContentEncoding preferred)
+    {
+        static const size_t COUNT = 3;
+
+        // Quality of each encoding, -1 if not listed
+        double quality[COUNT] = { -1.0, -1.0, -1.0 };
+        double wildcard = -1.0;
+
+        std::vector<std::string> codings;
+        TokenizeString(codings, acceptEncoding, ',');
+
+        for (size_t i = 0; i < codings.size(); i++)
+        {
+            std::vector<std::string> tokens;
+            TokenizeString(tokens, codings[i], ';');
+
+            double q = 1.0;
+            if (tokens.size() > 1)
+            {
+                const std::string parameter = StripSpaces(tokens[1]);
+                if (parameter.size() < 2 ||
+                    (parameter[0] != 'q' && parameter[0] != 'Q') ||
+                    parameter[1] != '=')
+                {
+                    continue;
+                }
+
+                const std::string value = StripSpaces(parameter.substr(2));
+                char* end = NULL;
+                q = strtod(value.c_str(), &end);
+                if (value.empty() || *end != '\0' || q < 0.0 || q > 1.0)
+                {
+                    continue;
+                }
+            }
+
+            ContentEncoding encoding;
+            if (StripSpaces(tokens[0]) == "*")
+            {
+                wildcard = q;
+            }
+            else if (LookupContentEncoding(encoding, tokens[0]))
+            {
+                quality[encoding] = q;
+            }
+        }
+
+        for (size_t i = 0; i < COUNT; i++)
+        {
+            if (quality[i] < 0.0)
+            {
+                if (wildcard >= 0.0)
+                {
+                    quality[i] = wildcard;
+                }
+                else
+                {
+                    // Unlisted codings are refused, except identity which
+                    // is always acceptable unless explicitly excluded
+                    quality[i] = (i == ContentEncoding_Identity ? 0.001 : 0.0);
+                }
+            }
+        }
+
+        const ContentEncoding order[COUNT + 1] =
+        {
+            preferred,
+            ContentEncoding_Gzip,
+            ContentEncoding_Deflate,
+            ContentEncoding_Identity
+        };
+
+        bool found = false;
+        for (size_t i = 0; i < COUNT + 1; i++)
+        {
+            const double q = quality[order[i]];
+            if (q > 0.0 &&
+                (!found || q > quality[target]))
+            {
+                target = order[i];
+                found = true;
+            }
+        }
+
+        return found;
+    }
+
+
+    static OrthancPluginCompressionType GetCompressionType(ContentEncoding encoding)
+    {
+        switch (encoding)
+        {
+            case ContentEncoding_Gzip:
+                return OrthancPluginCompressionType_Gzip;
+
+            case ContentEncoding_Deflate:
+                return OrthancPluginCompressionType_Zlib;
+
+            default:
+                throw PluginException(OrthancPluginErrorCode_ParameterOutOfRange);
+        }
+    }
+
+
+    void Transcode(std::string& target,
+                   OrthancPluginContext* context,
+                   const std::string& source,
+                   ContentEncoding sourceEncoding,
+                   ContentEncoding targetEncoding)
+    {
+        if (sourceEncoding == targetEncoding)
+        {
+            target = source;
+            return;
+        }
+
+        if (source.size() > UINT32_MAX)
+        {
+            // Beyond the reach of the compression services of Orthanc
+            throw PluginException(OrthancPluginErrorCode_NotEnoughMemory);
+        }
+
+        MemoryBuffer decoded(context);
+        const void* data = source.empty() ? NULL : source.c_str();
+        size_t size = source.size();
+
+        if (sourceEncoding != ContentEncoding_Identity)
+        {
+            OrthancPluginErrorCode code = OrthancPluginBufferCompression(
+                    context, *decoded, data, static_cast<uint32_t>(size), GetCompressionType(sourceEncoding), 1);
+            if (code != OrthancPluginErrorCode_Success)
+            {
+                throw PluginException(code);
+            }
+
+            data = decoded.GetData();
+            size = decoded.GetSize();
+        }
+
+        if (targetEncoding == ContentEncoding_Identity)
+        {
+            target.assign(static_cast<const char*>(data), size);
+            return;
+        }
+
+        MemoryBuffer encoded(context);
+        OrthancPluginErrorCode code = OrthancPluginBufferCompression(
+                context, *encoded, data, static_cast<uint32_t>(size), GetCompressionType(targetEncoding), 0);
+        if (code != OrthancPluginErrorCode_Success)
+        {
+            throw PluginException(code);
+        }
+
+        encoded.ToString(target);
+    }
+}
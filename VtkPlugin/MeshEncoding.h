@@ -0,0 +1,40 @@
+#ifndef VTKPLUGIN_MESHENCODING_H
+#define VTKPLUGIN_MESHENCODING_H
+
+#include <OrthancCPlugin.h>
+#include <string>
+
+namespace OrthancPlugins {
+
+    enum ContentEncoding
+    {
+        ContentEncoding_Identity,
+        ContentEncoding_Gzip,
+        ContentEncoding_Deflate     // zlib stream, as HTTP "deflate" means
+    };
+
+    // Token of the encoding in the Content-Encoding HTTP header
+    const char* EnumerationToString(ContentEncoding encoding);
+
+    bool LookupContentEncoding(ContentEncoding& target,
+                               const std::string& token);
+
+    /**
+     * Chooses the encoding of an answer from the value of the
+     * Accept-Encoding HTTP header. The preferred encoding wins among
+     * equally acceptable ones, then gzip, deflate and identity. Returns
+     * false if the client refuses even the identity encoding.
+     **/
+    bool NegotiateContentEncoding(ContentEncoding& target,
+                                  const std::string& acceptEncoding,
+                                  ContentEncoding preferred);
+
+    // Re-encodes a buffer with the compression services of Orthanc
+    void Transcode(std::string& target,
+                   OrthancPluginContext* context,
+                   const std::string& source,
+                   ContentEncoding sourceEncoding,
+                   ContentEncoding targetEncoding);
+}
+
+#endif
@@ -0,0 +1,204 @@
+#include "MeshFormats.h"
+#include "VtkPlugin.h"
+#include <cstdlib>
+#include <vector>
+
+namespace OrthancPlugins {
+
+    struct RegisteredFormat
+    {
+        const char*  contentType_;
+        MeshFormat   format_;
+    };
+
+    // In order of preference, the first one being the default
+    static const RegisteredFormat REGISTRY[] =
+    {
+        { "application/octet-stream", MeshFormat_VtkBinary },
+        { "model/gltf-binary",        MeshFormat_Glb },
+        { "application/ply",          MeshFormat_Ply },
+        { "model/stl",                MeshFormat_Stl }
+    };
+
+    static const size_t REGISTRY_SIZE = sizeof(REGISTRY) / sizeof(RegisteredFormat);
+
+
+    struct MediaRange
+    {
+        std::string  type_;
+        std::string  subtype_;
+        double       quality_;
+    };
+
+
+    // Malformed ranges are skipped, as if the client had not sent them
+    static void ParseAccept(std::vector<MediaRange>& target,
+                            const std::string& accept)
+    {
+        target.clear();
+
+        std::vector<std::string> ranges;
+        TokenizeString(ranges, accept, ',');
+
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            std::vector<std::string> tokens;
+            TokenizeString(tokens, ranges[i], ';');
+
+            std::string mime = StripSpaces(tokens[0]);
+            ToLowerCase(mime);
+            const size_t slash = mime.find('/');
+            if (slash == std::string::npos ||
+                slash == 0 ||
+                slash + 1 == mime.size())
+            {
+                continue;
+            }
+
+            MediaRange range;
+            range.type_ = mime.substr(0, slash);
+            range.subtype_ = mime.substr(slash + 1);
+            range.quality_ = 1.0;
+
+            if (range.type_ == "*" && range.subtype_ != "*")
+            {
+                continue;
+            }
+
+            bool valid = true;
+            for (size_t j = 1; j < tokens.size(); j++)
+            {
+                const std::string parameter = StripSpaces(tokens[j]);
+                const size_t equal = parameter.find('=');
+                if (equal != std::string::npos &&
+                    (StripSpaces(parameter.substr(0, equal)) == "q" ||
+                     StripSpaces(parameter.substr(0, equal)) == "Q"))
+                {
+                    const std::string value = StripSpaces(parameter.substr(equal + 1));
+                    char* end = NULL;
+                    range.quality_ = strtod(value.c_str(), &end);
+                    if (value.empty() ||
+                        *end != '\0' ||
+                        range.quality_ < 0.0 ||
+                        range.quality_ > 1.0)
+                    {
+                        valid = false;
+                    }
+                }
+            }
+
+            if (valid)
+            {
+                target.push_back(range);
+            }
+        }
+    }
+
+
+    // The quality of a content type is given by the most specific range
+    // that matches it. Returns the index of that range, or -1 if none.
+    static int MatchRange(const std::vector<MediaRange>& ranges,
+                          const std::string& contentType)
+    {
+        const size_t slash = contentType.find('/');
+        const std::string type = contentType.substr(0, slash);
+        const std::string subtype = contentType.substr(slash + 1);
+
+        int best = -1;
+        int bestSpecificity = -1;
+
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            int specificity;
+            if (ranges[i].type_ == type && ranges[i].subtype_ == subtype)
+            {
+                specificity = 2;
+            }
+            else if (ranges[i].type_ == type && ranges[i].subtype_ == "*")
+            {
+                specificity = 1;
+            }
+            else if (ranges[i].type_ == "*")
+            {
+                specificity = 0;
+            }
+            else
+            {
+                continue;
+            }
+
+            if (specificity > bestSpecificity)
+            {
+                best = static_cast<int>(i);
+                bestSpecificity = specificity;
+            }
+        }
+
+        return best;
+    }
+
+
+    bool NegotiateMeshFormat(std::string& contentType,
+                             const std::string& accept)
+    {
+        if (StripSpaces(accept).empty())
+        {
+            contentType = GetDefaultMeshContentType();
+            return true;
+        }
+
+        std::vector<MediaRange> ranges;
+        ParseAccept(ranges, accept);
+
+        int chosen = -1;
+        int chosenRange = -1;
+
+        for (size_t i = 0; i < REGISTRY_SIZE; i++)
+        {
+            const int range = MatchRange(ranges, REGISTRY[i].contentType_);
+            if (range < 0 ||
+                ranges[range].quality_ <= 0.0)
+            {
+                continue;
+            }
+
+            if (chosen < 0 ||
+                ranges[range].quality_ > ranges[chosenRange].quality_ ||
+                (ranges[range].quality_ == ranges[chosenRange].quality_ && range < chosenRange))
+            {
+                chosen = static_cast<int>(i);
+                chosenRange = range;
+            }
+        }
+
+        if (chosen < 0)
+        {
+            return false;
+        }
+
+        contentType = REGISTRY[chosen].contentType_;
+        return true;
+    }
+
+
+    bool LookupMeshFormat(MeshFormat& format,
+                          const std::string& contentType)
+    {
+        for (size_t i = 0; i < REGISTRY_SIZE; i++)
+        {
+            if (contentType == REGISTRY[i].contentType_)
+            {
+                format = REGISTRY[i].format_;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    const char* GetDefaultMeshContentType()
+    {
+        return REGISTRY[0].contentType_;
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef VTKPLUGIN_MESHFORMATS_H
+#define VTKPLUGIN_MESHFORMATS_H
+
+#include "dicomtoitk-1.0/MeshWriters.h"
+#include <string>
+
+namespace OrthancPlugins {
+
+    /**
+     * Chooses the output format of a mesh from the value of the Accept
+     * HTTP header, honoring quality values and wildcards. Among equally
+     * acceptable formats, the one listed first by the client wins, then
+     * the first one registered. An empty header selects the default
+     * format. Returns false if none of the formats is acceptable.
+     **/
+    bool NegotiateMeshFormat(std::string& contentType,
+                             const std::string& accept);
+
+    // Returns false if no writer is registered for this content type
+    bool LookupMeshFormat(MeshFormat& format,
+                          const std::string& contentType);
+
+    const char* GetDefaultMeshContentType();
+}
+
+#endif
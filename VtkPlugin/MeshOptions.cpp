@@ -0,0 +1,282 @@
+#include "MeshOptions.h"
+#include "MeshFormats.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+namespace OrthancPlugins {
+
+    static bool ParseUnsignedInteger(unsigned long long& target,
+                                     const std::string& value,
+                                     unsigned long long maximum)
+    {
+        if (value.empty() ||
+            value.find_first_not_of("0123456789") != std::string::npos)
+        {
+            return false;
+        }
+
+        errno = 0;
+        const unsigned long long parsed = strtoull(value.c_str(), NULL, 10);
+        if (errno != 0 ||
+            parsed > maximum)
+        {
+            return false;
+        }
+
+        target = parsed;
+        return true;
+    }
+
+
+    static bool ParseReduction(double& target,
+                               const std::string& value)
+    {
+        if (value.empty() ||
+            value.find_first_not_of("0123456789.") != std::string::npos)
+        {
+            return false;
+        }
+
+        char* end = NULL;
+        const double parsed = strtod(value.c_str(), &end);
+        if (*end != '\0' ||
+            !(parsed >= 0 && parsed < 1))
+        {
+            return false;
+        }
+
+        target = parsed;
+        return true;
+    }
+
+
+    static const size_t MAX_RANGES = 256;
+
+    // "LOW-HIGH" or "LOW" for a threshold, a whole number for a label. Both
+    // bounds are decimal numbers, possibly negative, such as Hounsfield
+    // units.
+    static bool ParseRange(ThresholdRange& target,
+                           const std::string& token,
+                           bool label)
+    {
+        if (token.empty() ||
+            token.find_first_not_of("0123456789.-") != std::string::npos)
+        {
+            return false;
+        }
+
+        char* end = NULL;
+        target.lower = strtod(token.c_str(), &end);
+        if (end == token.c_str())
+        {
+            return false;
+        }
+
+        if (*end == '\0')
+        {
+            target.upper = label ? target.lower : std::numeric_limits<double>::infinity();
+        }
+        else if (*end == '-' &&
+                 !label)
+        {
+            const char* upper = end + 1;
+            target.upper = strtod(upper, &end);
+            if (end == upper ||
+                *end != '\0')
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+
+        if (label &&
+            target.lower != std::floor(target.lower))
+        {
+            return false;
+        }
+
+        return (std::isfinite(target.lower) &&
+                target.lower <= target.upper);
+    }
+
+    static bool ParseRanges(std::vector<ThresholdRange>& target,
+                            const std::string& value,
+                            bool labels)
+    {
+        target.clear();
+
+        size_t start = 0;
+        for (;;)
+        {
+            const size_t comma = value.find(',', start);
+            const std::string token = value.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+
+            ThresholdRange range;
+            if (!ParseRange(range, token, labels) ||
+                target.size() == MAX_RANGES)
+            {
+                return false;
+            }
+
+            target.push_back(range);
+
+            if (comma == std::string::npos)
+            {
+                return true;
+            }
+
+            start = comma + 1;
+        }
+    }
+
+
+    std::string FormatThreshold(double value)
+    {
+        if (std::isinf(value))
+        {
+            return value < 0 ? "-inf" : "inf";
+        }
+
+        char tmp[32];
+        snprintf(tmp, sizeof(tmp), "%.17g", value);
+        return tmp;
+    }
+
+
+    bool ParseMeshOptions(MeshOptions& target,
+                          const OrthancPluginHttpRequest* request)
+    {
+        unsigned int count = 0;
+        unsigned int selections = 0;
+
+        for (uint32_t i = 0; i < request->getCount; i++)
+        {
+            const std::string key(request->getKeys[i]);
+            const std::string value(request->getValues[i]);
+
+            if (key == "targetTriangles")
+            {
+                unsigned long long parsed;
+                if (!ParseUnsignedInteger(parsed, value, static_cast<size_t>(-1)) ||
+                    parsed == 0)
+                {
+                    return false;
+                }
+
+                target.targetTriangles = static_cast<size_t>(parsed);
+                count++;
+            }
+            else if (key == "reduction")
+            {
+                if (!ParseReduction(target.reduction, value))
+                {
+                    return false;
+                }
+
+                count++;
+            }
+            else if (key == "lod")
+            {
+                unsigned long long parsed;
+                if (!ParseUnsignedInteger(parsed, value, 255))
+                {
+                    return false;
+                }
+
+                target.pyramid = true;
+                target.lod = static_cast<unsigned int>(parsed);
+                count++;
+            }
+            else if (key == "threshold" ||
+                     key == "labels")
+            {
+                if (!ParseRanges(target.ranges, value, key == "labels"))
+                {
+                    return false;
+                }
+
+                selections++;
+            }
+            else if (key == "precision")
+            {
+                if (value == "quantized16")
+                {
+                    target.precision = MeshPrecision_Quantized16;
+                }
+                else if (value == "float32")
+                {
+                    target.precision = MeshPrecision_Float32;
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            else if (key == "stream")
+            {
+                if (value == "true" || value == "1")
+                {
+                    target.stream = true;
+                    count++;
+                }
+                else if (value != "false" && value != "0")
+                {
+                    return false;
+                }
+            }
+        }
+
+        if (target.ranges.size() > 1 &&
+            (target.pyramid || target.stream))
+        {
+            return false;
+        }
+
+        return count <= 1 && selections <= 1;
+    }
+
+
+    std::string FormatMeshOptions(const MeshOptions& options)
+    {
+        std::string s = options.contentType;
+
+        if (options.targetTriangles != 0)
+        {
+            s += ";targetTriangles=" + std::to_string(options.targetTriangles);
+        }
+        else if (options.reduction > 0)
+        {
+            // Enough digits for distinct reductions to map to distinct keys
+            char tmp[32];
+            snprintf(tmp, sizeof(tmp), "%.17g", options.reduction);
+            s += ";reduction=" + std::string(tmp);
+        }
+        else if (options.lod != 0)
+        {
+            s += ";lod=" + std::to_string(options.lod);
+        }
+
+        for (size_t i = 0; i < options.ranges.size(); i++)
+        {
+            s += (i == 0 ? ";ranges=" : ",") + FormatThreshold(options.ranges[i].lower) +
+                 "-" + FormatThreshold(options.ranges[i].upper);
+        }
+
+        // Only glTF has quantized positions, the other formats share a key
+        MeshFormat format;
+        if (options.precision == MeshPrecision_Quantized16 &&
+            LookupMeshFormat(format, options.contentType) &&
+            format == MeshFormat_Glb)
+        {
+            s += ";precision=quantized16";
+        }
+
+        return s;
+    }
+}
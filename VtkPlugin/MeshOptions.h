@@ -0,0 +1,62 @@
+#ifndef VTKPLUGIN_MESHOPTIONS_H
+#define VTKPLUGIN_MESHOPTIONS_H
+
+#include <OrthancCPlugin.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "dicomtoitk-1.0/dicomToItk.h"
+
+namespace OrthancPlugins {
+
+    // What a client asked for when requesting the mesh of a series
+    struct MeshOptions
+    {
+        std::string  contentType;
+        size_t       targetTriangles;   // 0 if the mesh is not decimated to a budget
+        double       reduction;         // Fraction of the triangles to remove, 0 to keep them all
+        bool         pyramid;           // Whether all the levels of detail are generated at once
+        unsigned int lod;               // Level of detail, 0 being the full mesh
+        bool         stream;            // Whether the mesh is sent slab by slab as it is extracted
+        std::vector<ThresholdRange>  ranges;  // One mesh per range, empty for the default binary mask
+        MeshPrecision                precision;  // Of the positions, only quantized in glTF
+
+        MeshOptions() :
+                targetTriangles(0),
+                reduction(0),
+                pyramid(false),
+                lod(0),
+                stream(false),
+                precision(MeshPrecision_Float32)
+        {
+        }
+    };
+
+    /**
+     * Reads the "targetTriangles", "reduction", "lod" and "stream" GET
+     * arguments of a mesh request, leaving the content type untouched.
+     * Returns false on malformed values, or if more than one of them is
+     * given. Asking for a level of detail selects the pyramid.
+     *
+     * The voxels to mesh are given either by "threshold", a comma-separated
+     * list of "LOW-HIGH" inclusive ranges of rescaled values, such as
+     * "-500-300" in Hounsfield units (a single "LOW" meaning up to the
+     * largest value), or by "labels", a comma-separated list of whole values.
+     * Several ranges cannot be combined with "lod" or "stream".
+     *
+     * "precision" is "float32" (the default) or "quantized16", for 16-bit
+     * positions across the bounding box of the mesh in glTF answers.
+     **/
+    bool ParseMeshOptions(MeshOptions& target,
+                          const OrthancPluginHttpRequest* request);
+
+    // Canonical form of the options, as a part of the cache keys. Level 0
+    // of the pyramid and streamed meshes share the key of the undecimated
+    // mesh, and labels share the keys of the equivalent thresholds.
+    std::string FormatMeshOptions(const MeshOptions& options);
+
+    // Bound of a threshold range with all its digits, "inf" when unbounded
+    std::string FormatThreshold(double value);
+}
+
+#endif
@@ -0,0 +1,108 @@
+#include "PrecomputeQueue.h"
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace OrthancPlugins {
+
+    static void LowerCurrentThreadPriority()
+    {
+#if defined(__linux__)
+        // On Linux, the nice value applies to the calling thread only
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+#endif
+    }
+
+
+    PrecomputeQueue::PrecomputeQueue(const Handler& handler) :
+            handler_(handler),
+            stopped_(true)
+    {
+    }
+
+
+    PrecomputeQueue::~PrecomputeQueue()
+    {
+        Stop();
+    }
+
+
+    void PrecomputeQueue::Start(unsigned int threads)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        if (!stopped_)
+        {
+            return;
+        }
+
+        stopped_ = false;
+        for (unsigned int i = 0; i < threads; i++)
+        {
+            workers_.create_thread([this]() { Worker(); });
+        }
+    }
+
+
+    void PrecomputeQueue::Stop()
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            stopped_ = true;
+            queue_.clear();
+            pending_.clear();
+            available_.notify_all();
+        }
+
+        workers_.join_all();
+    }
+
+
+    void PrecomputeQueue::Enqueue(const std::string& seriesId)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        if (stopped_ ||
+            !pending_.insert(seriesId).second)
+        {
+            return;
+        }
+
+        queue_.push_back(seriesId);
+        available_.notify_one();
+    }
+
+
+    void PrecomputeQueue::Worker()
+    {
+        LowerCurrentThreadPriority();
+
+        for (;;)
+        {
+            std::string seriesId;
+
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+
+                while (queue_.empty() && !stopped_)
+                {
+                    available_.wait(lock);
+                }
+
+                if (stopped_)
+                {
+                    return;
+                }
+
+                seriesId = queue_.front();
+                queue_.pop_front();
+                pending_.erase(seriesId);
+            }
+
+            handler_(seriesId);
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef VTKPLUGIN_PRECOMPUTEQUEUE_H
+#define VTKPLUGIN_PRECOMPUTEQUEUE_H
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <deque>
+#include <functional>
+#include <set>
+#include <string>
+
+namespace OrthancPlugins {
+
+    /**
+     * Queue of series waiting for their mesh to be computed in the
+     * background. The workers run at the lowest scheduling priority, so
+     * interactive requests always get the CPU first. A series that is
+     * already waiting is not queued twice.
+     **/
+    class PrecomputeQueue : public boost::noncopyable
+    {
+    public:
+        typedef std::function<void(const std::string& seriesId)>  Handler;
+
+    private:
+        Handler                    handler_;
+        boost::mutex               mutex_;
+        boost::condition_variable  available_;
+        std::deque<std::string>    queue_;
+        std::set<std::string>      pending_;
+        bool                       stopped_;
+        boost::thread_group        workers_;
+
+        void Worker();
+
+    public:
+        explicit PrecomputeQueue(const Handler& handler);
+
+        ~PrecomputeQueue();
+
+        void Start(unsigned int threads);
+
+        void Stop();
+
+        void Enqueue(const std::string& seriesId);
+    };
+}
+
+#endif
@@ -0,0 +1,361 @@
+#include "SeriesFetcher.h"
+#include "SliceLayout.h"
+
+#include <boost/thread.hpp>
+#include <deque>
+#include <memory>
+
+namespace OrthancPlugins {
+
+    namespace
+    {
+        typedef std::shared_ptr<MemoryBuffer>  DicomPointer;
+
+        struct FetchedInstance
+        {
+            size_t        index;  // In the list of instances to fetch
+            DicomPointer  dicom;
+        };
+
+        class InstanceQueue : public boost::noncopyable
+        {
+        private:
+            boost::mutex                 mutex_;
+            boost::condition_variable    notEmpty_;
+            boost::condition_variable    notFull_;
+            std::deque<FetchedInstance>  items_;
+            size_t                       capacity_;
+            unsigned int                 producers_;
+            OrthancPluginErrorCode       error_;
+
+        public:
+            InstanceQueue(size_t capacity,
+                          unsigned int producers) :
+                    capacity_(capacity),
+                    producers_(producers),
+                    error_(OrthancPluginErrorCode_Success)
+            {
+            }
+
+            bool Push(const FetchedInstance& item)
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+
+                while (items_.size() >= capacity_ &&
+                       error_ == OrthancPluginErrorCode_Success)
+                {
+                    notFull_.wait(lock);
+                }
+
+                if (error_ != OrthancPluginErrorCode_Success)
+                {
+                    return false;
+                }
+
+                items_.push_back(item);
+                notEmpty_.notify_one();
+                return true;
+            }
+
+            // Returns false once every producer is done and the queue is
+            // drained, or as soon as a worker has failed
+            bool Pop(FetchedInstance& item)
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+
+                while (items_.empty() &&
+                       producers_ > 0 &&
+                       error_ == OrthancPluginErrorCode_Success)
+                {
+                    notEmpty_.wait(lock);
+                }
+
+                if (items_.empty() ||
+                    error_ != OrthancPluginErrorCode_Success)
+                {
+                    return false;
+                }
+
+                item = items_.front();
+                items_.pop_front();
+                notFull_.notify_one();
+                return true;
+            }
+
+            void ProducerDone()
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                producers_--;
+                notEmpty_.notify_all();
+            }
+
+            void Fail(OrthancPluginErrorCode error)
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                if (error_ == OrthancPluginErrorCode_Success)
+                {
+                    error_ = error;
+                }
+
+                items_.clear();
+                notEmpty_.notify_all();
+                notFull_.notify_all();
+            }
+
+            OrthancPluginErrorCode GetError()
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                return error_;
+            }
+        };
+
+
+        class OrthancImage : public boost::noncopyable
+        {
+        private:
+            OrthancPluginContext*  context_;
+            OrthancPluginImage*    image_;
+
+        public:
+            OrthancImage(OrthancPluginContext* context,
+                         OrthancPluginImage* image) :
+                    context_(context),
+                    image_(image)
+            {
+            }
+
+            ~OrthancImage()
+            {
+                if (image_ != NULL)
+                {
+                    OrthancPluginFreeImage(context_, image_);
+                }
+            }
+
+            OrthancPluginImage* operator*()
+            {
+                return image_;
+            }
+        };
+    }
+
+
+    // Reads a decimal tag out of the JSON of an instance, in its short format
+    static double GetDecimalTag(const Json::Value& tags,
+                                const char* tag,
+                                double defaultValue)
+    {
+        double value;
+        if (tags.isMember(tag) &&
+            tags[tag].isString() &&
+            ParseDecimalValues(&value, 1, tags[tag].asString()))
+        {
+            return value;
+        }
+
+        return defaultValue;
+    }
+
+
+    // Decodes an instance with the decoders of Orthanc, its plugin codecs
+    // included, straight into its place in the volume. The pixel formats
+    // Orthanc cannot hand over, and the instances it cannot decode, are
+    // left to the decoder of the generator.
+    static bool PlaceSlice(OrthancPluginContext* context,
+                           SliceSink& sink,
+                           const DicomBuffer& buffer,
+                           size_t index)
+    {
+        const uint32_t size = static_cast<uint32_t>(buffer.size);
+        OrthancImage image(context, OrthancPluginDecodeDicomImage(context, buffer.data, size, 0));
+        if (*image == NULL)
+        {
+            return sink.addInstance(buffer, index);
+        }
+
+        SlicePixels pixels;
+        switch (OrthancPluginGetImagePixelFormat(context, *image))
+        {
+            case OrthancPluginPixelFormat_Grayscale8:
+                pixels.format = SliceFormat_UInt8;
+                break;
+
+            case OrthancPluginPixelFormat_Grayscale16:
+                pixels.format = SliceFormat_UInt16;
+                break;
+
+            case OrthancPluginPixelFormat_SignedGrayscale16:
+                pixels.format = SliceFormat_Int16;
+                break;
+
+            default:
+                return sink.addInstance(buffer, index);
+        }
+
+        // The decoded pixels are the stored values, before the rescale
+        char* json = OrthancPluginDicomBufferToJson(context, buffer.data, size,
+                                                    OrthancPluginDicomToJsonFormat_Short,
+                                                    static_cast<OrthancPluginDicomToJsonFlags>(0), 256);
+        if (json == NULL)
+        {
+            return sink.addInstance(buffer, index);
+        }
+
+        Json::Value tags;
+        Json::Reader reader;
+        const bool parsed = reader.parse(json, tags);
+        OrthancPluginFreeString(context, json);
+        if (!parsed)
+        {
+            return sink.addInstance(buffer, index);
+        }
+
+        // PixelSpacing runs from one row to the next first
+        double spacing[2];
+        if (!tags.isMember("0028,0030") ||
+            !ParseDecimalValues(spacing, 2, tags["0028,0030"].asString()))
+        {
+            spacing[0] = 1.0;
+            spacing[1] = 1.0;
+        }
+
+        pixels.width = OrthancPluginGetImageWidth(context, *image);
+        pixels.height = OrthancPluginGetImageHeight(context, *image);
+        pixels.pitch = OrthancPluginGetImagePitch(context, *image);
+        pixels.buffer = OrthancPluginGetImageBuffer(context, *image);
+        pixels.spacing[0] = spacing[1];
+        pixels.spacing[1] = spacing[0];
+        pixels.slope = GetDecimalTag(tags, "0028,1053", 1.0);
+        pixels.intercept = GetDecimalTag(tags, "0028,1052", 0.0);
+
+        return sink.addSlice(pixels, index);
+    }
+
+
+    SeriesFetcher::SeriesFetcher(OrthancPluginContext* context,
+                                 unsigned int fetchThreads,
+                                 unsigned int decodeThreads) :
+            context_(context),
+            fetchThreads_(fetchThreads == 0 ? 1 : fetchThreads),
+            decodeThreads_(decodeThreads == 0 ? 1 : decodeThreads)
+    {
+    }
+
+
+    void SeriesFetcher::Fetch(VtkGenerator& generator,
+                              const std::vector<std::string>& instances,
+                              bool placeSlices)
+    {
+        InstanceQueue queue(2 * (fetchThreads_ + decodeThreads_), fetchThreads_);
+
+        boost::mutex nextMutex;
+        size_t next = 0;
+
+        boost::thread_group workers;
+
+        for (unsigned int i = 0; i < fetchThreads_; i++)
+        {
+            workers.create_thread([&]()
+            {
+                try
+                {
+                    for (;;)
+                    {
+                        size_t index;
+
+                        {
+                            boost::mutex::scoped_lock lock(nextMutex);
+                            if (next == instances.size())
+                            {
+                                break;
+                            }
+
+                            index = next++;
+                        }
+
+                        DicomPointer dicom(new MemoryBuffer(context_));
+                        if (!dicom->RestApiGet("/instances/" + instances[index] + "/file", false))
+                        {
+                            OrthancPluginLogError(context_, ("Instance " + instances[index] +
+                                                             " vanished while reading the series").c_str());
+                            queue.Fail(OrthancPluginErrorCode_UnknownResource);
+                            break;
+                        }
+
+                        if (!queue.Push(FetchedInstance{index, dicom}))
+                        {
+                            break;
+                        }
+                    }
+                }
+                catch (PluginException& e)
+                {
+                    queue.Fail(e.GetErrorCode());
+                }
+                catch (...)
+                {
+                    queue.Fail(OrthancPluginErrorCode_InternalError);
+                }
+
+                queue.ProducerDone();
+            });
+        }
+
+        for (unsigned int i = 0; i < decodeThreads_; i++)
+        {
+            workers.create_thread([&]()
+            {
+                try
+                {
+                    FetchedInstance item;
+                    while (queue.Pop(item))
+                    {
+                        const DicomBuffer buffer(item.dicom->GetData(), item.dicom->GetSize(), item.dicom);
+                        if (placeSlices ?
+                            !PlaceSlice(context_, generator, buffer, item.index) :
+                            !generator.addInstance(buffer))
+                        {
+                            queue.Fail(OrthancPluginErrorCode_BadFileFormat);
+                        }
+
+                        item.dicom.reset();
+                    }
+                }
+                catch (...)
+                {
+                    queue.Fail(OrthancPluginErrorCode_InternalError);
+                }
+            });
+        }
+
+        workers.join_all();
+
+        if (queue.GetError() != OrthancPluginErrorCode_Success)
+        {
+            throw PluginException(queue.GetError());
+        }
+    }
+
+
+    void SeriesFetcher::Fetch(SliceSink& sink,
+                              const std::vector<std::string>& instances,
+                              size_t first,
+                              size_t last)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            MemoryBuffer dicom(context_);
+            if (!dicom.RestApiGet("/instances/" + instances[i] + "/file", false))
+            {
+                OrthancPluginLogError(context_, ("Instance " + instances[i] +
+                                                 " vanished while reading the series").c_str());
+                throw PluginException(OrthancPluginErrorCode_UnknownResource);
+            }
+
+            if (!PlaceSlice(context_, sink, DicomBuffer(dicom.GetData(), dicom.GetSize()), i))
+            {
+                throw PluginException(OrthancPluginErrorCode_BadFileFormat);
+            }
+        }
+    }
+}
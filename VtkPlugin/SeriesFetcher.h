@@ -0,0 +1,50 @@
+#ifndef VTKPLUGIN_SERIESFETCHER_H
+#define VTKPLUGIN_SERIESFETCHER_H
+
+#include "VtkPlugin.h"
+#include "dicomtoitk-1.0/dicomToItk.h"
+#include <boost/noncopyable.hpp>
+#include <string>
+#include <vector>
+
+namespace OrthancPlugins {
+
+    /**
+     * Downloads the instances of a series with a bounded pool of fetch
+     * workers. Every buffer goes through a bounded queue to the decode
+     * workers, which hand it to the generator as soon as it arrives, so
+     * decoding one slice overlaps with fetching the next ones and at most
+     * a queue's worth of raw instances is held in memory. Once the
+     * generator has a slice layout, the instances must come in its order,
+     * and each one is decoded by Orthanc straight into its slot of the
+     * volume. The instances of a laid out series may also be fetched a
+     * range at a time, for the generator to mesh it slab by slab.
+     **/
+    class SeriesFetcher : public boost::noncopyable
+    {
+    private:
+        OrthancPluginContext*  context_;
+        unsigned int           fetchThreads_;
+        unsigned int           decodeThreads_;
+
+    public:
+        SeriesFetcher(OrthancPluginContext* context,
+                      unsigned int fetchThreads,
+                      unsigned int decodeThreads);
+
+        void Fetch(VtkGenerator& generator,
+                   const std::vector<std::string>& instances,
+                   bool placeSlices);
+
+        // Hands the instances [first, last) of a series over to the sink,
+        // along with their index in the list. They are fetched and decoded
+        // one after the other on the calling thread, without any worker:
+        // the slabs that call this are already loaded in parallel.
+        void Fetch(SliceSink& sink,
+                   const std::vector<std::string>& instances,
+                   size_t first,
+                   size_t last);
+    };
+}
+
+#endif
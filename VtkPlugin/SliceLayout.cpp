@@ -0,0 +1,158 @@
+#include "SliceLayout.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_map>
+
+namespace OrthancPlugins {
+
+    namespace
+    {
+        struct IndexedSlice
+        {
+            std::string  id;
+            double       origin[3];
+            double       cosines[6];
+            double       position;
+            long         number;
+        };
+    }
+
+
+    bool ParseDecimalValues(double* target,
+                            size_t count,
+                            const std::string& value)
+    {
+        const char* current = value.c_str();
+        for (size_t i = 0; i < count; i++)
+        {
+            char* end = NULL;
+            target[i] = strtod(current, &end);
+            while (end != NULL && *end == ' ')
+            {
+                end++;
+            }
+
+            if (end == current ||
+                *end != (i + 1 == count ? '\0' : '\\'))
+            {
+                return false;
+            }
+
+            current = end + 1;
+        }
+
+        return true;
+    }
+
+
+    static bool ParseValues(double* target,
+                            size_t count,
+                            const Json::Value& tags,
+                            const char* name)
+    {
+        return (tags.isMember(name) &&
+                tags[name].isString() &&
+                ParseDecimalValues(target, count, tags[name].asString()));
+    }
+
+
+    static bool ParseSlice(IndexedSlice& slice,
+                           const Json::Value& instance)
+    {
+        const Json::Value& tags = instance["MainDicomTags"];
+
+        if (tags.isMember("NumberOfFrames") &&
+            atoi(tags["NumberOfFrames"].asString().c_str()) > 1)
+        {
+            return false;
+        }
+
+        slice.id = instance["ID"].asString();
+        slice.number = tags.isMember("InstanceNumber") ? atol(tags["InstanceNumber"].asString().c_str()) : 0;
+
+        return (ParseValues(slice.origin, 3, tags, "ImagePositionPatient") &&
+                ParseValues(slice.cosines, 6, tags, "ImageOrientationPatient"));
+    }
+
+
+    bool LookupSliceLayout(SliceLayout& layout,
+                           std::vector<std::string>& sorted,
+                           OrthancPluginContext* context,
+                           const std::string& seriesId,
+                           const std::vector<std::string>& instances)
+    {
+        Json::Value response;
+        if (!RestApiGetJson(response, context, "/series/" + seriesId + "/instances", false) ||
+            !response.isArray())
+        {
+            return false;
+        }
+
+        std::unordered_map<std::string, Json::ArrayIndex> found;
+        for (Json::ArrayIndex i = 0; i < response.size(); i++)
+        {
+            found[response[i]["ID"].asString()] = i;
+        }
+
+        // Only the instances the caller knows of, which the series may have
+        // gained or lost since
+        std::vector<IndexedSlice> slices(instances.size());
+        for (size_t i = 0; i < instances.size(); i++)
+        {
+            auto instance = found.find(instances[i]);
+            if (instance == found.end() ||
+                !ParseSlice(slices[i], response[instance->second]))
+            {
+                return false;
+            }
+        }
+
+        if (slices.empty())
+        {
+            return false;
+        }
+
+        const double* rows = slices.front().cosines;
+        const double* columns = slices.front().cosines + 3;
+        const double normal[3] = {
+                rows[1] * columns[2] - rows[2] * columns[1],
+                rows[2] * columns[0] - rows[0] * columns[2],
+                rows[0] * columns[1] - rows[1] * columns[0]
+        };
+
+        for (size_t i = 0; i < slices.size(); i++)
+        {
+            for (unsigned int j = 0; j < 6; j++)
+            {
+                if (std::fabs(slices[i].cosines[j] - slices.front().cosines[j]) > 1e-4)
+                {
+                    return false;
+                }
+            }
+
+            slices[i].position = (slices[i].origin[0] * normal[0] +
+                                  slices[i].origin[1] * normal[1] +
+                                  slices[i].origin[2] * normal[2]);
+        }
+
+        std::sort(slices.begin(), slices.end(), [](const IndexedSlice& a, const IndexedSlice& b)
+        {
+            return (a.position < b.position ||
+                    (a.position == b.position && a.number < b.number));
+        });
+
+        layout.count = slices.size();
+        std::copy(slices.front().origin, slices.front().origin + 3, layout.origin);
+        std::copy(slices.front().cosines, slices.front().cosines + 6, layout.cosines);
+        layout.spacing = slices.size() > 1 ? std::fabs(slices[1].position - slices[0].position) : 1.0;
+
+        sorted.resize(slices.size());
+        for (size_t i = 0; i < slices.size(); i++)
+        {
+            sorted[i] = slices[i].id;
+        }
+
+        return true;
+    }
+}
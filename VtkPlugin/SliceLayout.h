@@ -0,0 +1,33 @@
+#ifndef VTKPLUGIN_SLICELAYOUT_H
+#define VTKPLUGIN_SLICELAYOUT_H
+
+#include "VtkPlugin.h"
+#include "dicomtoitk-1.0/dicomToItk.h"
+#include <string>
+#include <vector>
+
+namespace OrthancPlugins {
+
+    // Parses a multi-valued decimal string of a DICOM tag, such as
+    // "-125\0.5\40", which must hold exactly "count" values
+    bool ParseDecimalValues(double* target,
+                            size_t count,
+                            const std::string& value);
+
+    /**
+     * Orders the instances of a series along the normal of their slices out
+     * of the ImagePositionPatient, ImageOrientationPatient and
+     * InstanceNumber tags that Orthanc indexes, the latter breaking ties,
+     * so that the generator neither parses every header to sort them nor
+     * waits for all of them to place them. Returns false, leaving the
+     * ordering to the generator, if an instance lacks these tags or has
+     * several frames, or if the slices are not parallel.
+     **/
+    bool LookupSliceLayout(SliceLayout& layout,
+                           std::vector<std::string>& sorted,
+                           OrthancPluginContext* context,
+                           const std::string& seriesId,
+                           const std::vector<std::string>& instances);
+}
+
+#endif
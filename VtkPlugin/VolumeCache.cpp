@@ -0,0 +1,166 @@
+#include "VolumeCache.h"
+
+namespace OrthancPlugins {
+
+    VolumeCache::VolumeCache(size_t maximumSize) :
+            maximumSize_(maximumSize),
+            currentSize_(0)
+    {
+    }
+
+
+    void VolumeCache::Forget(Owners& owners,
+                             const std::string& id,
+                             const std::string& key)
+    {
+        auto range = owners.equal_range(id);
+        for (auto owner = range.first; owner != range.second; ++owner)
+        {
+            if (owner->second == key)
+            {
+                owners.erase(owner);
+                return;
+            }
+        }
+    }
+
+
+    void VolumeCache::Remove(Index::iterator it)
+    {
+        const Entry& entry = *it->second;
+
+        Forget(seriesKeys_, entry.seriesId, entry.key);
+        for (size_t i = 0; i < entry.instances.size(); i++)
+        {
+            Forget(instanceKeys_, entry.instances[i], entry.key);
+        }
+
+        currentSize_ -= entry.size;
+        queue_.erase(it->second);
+        index_.erase(it);
+    }
+
+
+    void VolumeCache::RemoveOwned(Owners& owners,
+                                  const std::string& id)
+    {
+        std::vector<std::string> keys;
+        auto range = owners.equal_range(id);
+        for (auto owner = range.first; owner != range.second; ++owner)
+        {
+            keys.push_back(owner->second);
+        }
+
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            Index::iterator found = index_.find(keys[i]);
+            if (found != index_.end())
+            {
+                Remove(found);
+            }
+        }
+    }
+
+
+    void VolumeCache::SetMaximumSize(size_t maximumSize)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        maximumSize_ = maximumSize;
+
+        while (currentSize_ > maximumSize_)
+        {
+            Remove(index_.find(queue_.back().key));
+        }
+    }
+
+
+    bool VolumeCache::IsEnabled()
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        return maximumSize_ > 0;
+    }
+
+
+    bool VolumeCache::Lookup(DecodedVolumePointer& volume,
+                             const std::string& key)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        Index::iterator found = index_.find(key);
+        if (found == index_.end())
+        {
+            return false;
+        }
+
+        queue_.splice(queue_.begin(), queue_, found->second);
+        volume = found->second->volume;
+        return true;
+    }
+
+
+    void VolumeCache::Store(const std::string& key,
+                            const std::string& seriesId,
+                            const std::vector<std::string>& instances,
+                            const DecodedVolumePointer& volume)
+    {
+        const size_t size = getMemoryFootprint(*volume);
+
+        boost::mutex::scoped_lock lock(mutex_);
+
+        Index::iterator found = index_.find(key);
+        if (found != index_.end())
+        {
+            Remove(found);
+        }
+
+        if (size > maximumSize_)
+        {
+            return;
+        }
+
+        while (currentSize_ + size > maximumSize_)
+        {
+            Remove(index_.find(queue_.back().key));
+        }
+
+        Entry entry;
+        entry.key = key;
+        entry.seriesId = seriesId;
+        entry.instances = instances;
+        entry.volume = volume;
+        entry.size = size;
+
+        queue_.push_front(entry);
+        index_[key] = queue_.begin();
+        currentSize_ += size;
+
+        seriesKeys_.insert(std::make_pair(seriesId, key));
+        for (size_t i = 0; i < instances.size(); i++)
+        {
+            instanceKeys_.insert(std::make_pair(instances[i], key));
+        }
+    }
+
+
+    void VolumeCache::InvalidateSeries(const std::string& seriesId)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        RemoveOwned(seriesKeys_, seriesId);
+    }
+
+
+    void VolumeCache::InvalidateInstance(const std::string& instanceId)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        RemoveOwned(instanceKeys_, instanceId);
+    }
+
+
+    std::string VolumeCache::GetKey(const std::string& studyUid,
+                                    const std::string& seriesUid,
+                                    const std::string& instancesHash)
+    {
+        return studyUid + "|" + seriesUid + "|" + instancesHash;
+    }
+}
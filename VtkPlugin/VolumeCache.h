@@ -0,0 +1,81 @@
+#ifndef VTKPLUGIN_VOLUMECACHE_H
+#define VTKPLUGIN_VOLUMECACHE_H
+
+#include "dicomtoitk-1.0/dicomToItk.h"
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace OrthancPlugins {
+
+    /**
+     * In-memory cache of decoded volumes, so that meshing a series again
+     * with other parameters skips its download and its decoding. Bounded by
+     * the memory footprint of the volumes and evicted in least-recently-used
+     * order, like the mesh cache. The volumes are dropped as soon as their
+     * series gets a new instance or loses one.
+     **/
+    class VolumeCache : public boost::noncopyable
+    {
+    private:
+        struct Entry
+        {
+            std::string               key;
+            std::string               seriesId;   // Orthanc identifier of the series
+            std::vector<std::string>  instances;  // Orthanc identifiers of the instances
+            DecodedVolumePointer      volume;
+            size_t                    size;
+        };
+
+        typedef std::list<Entry>                                  Queue;  // Most recently used first
+        typedef std::unordered_map<std::string, Queue::iterator>  Index;
+        typedef std::unordered_multimap<std::string, std::string> Owners;
+
+        boost::mutex  mutex_;
+        Queue         queue_;
+        Index         index_;
+        Owners        seriesKeys_;    // Keys of the volumes of a series
+        Owners        instanceKeys_;  // Keys of the volumes holding an instance
+        size_t        maximumSize_;
+        size_t        currentSize_;
+
+        static void Forget(Owners& owners,
+                           const std::string& id,
+                           const std::string& key);
+
+        void Remove(Index::iterator it);
+
+        void RemoveOwned(Owners& owners,
+                         const std::string& id);
+
+    public:
+        explicit VolumeCache(size_t maximumSize);
+
+        void SetMaximumSize(size_t maximumSize);
+
+        bool IsEnabled();
+
+        bool Lookup(DecodedVolumePointer& volume,
+                    const std::string& key);
+
+        void Store(const std::string& key,
+                   const std::string& seriesId,
+                   const std::vector<std::string>& instances,
+                   const DecodedVolumePointer& volume);
+
+        // Drops the volumes of a series, given its Orthanc identifier
+        void InvalidateSeries(const std::string& seriesId);
+
+        // Drops the volumes built out of an instance, given its Orthanc identifier
+        void InvalidateInstance(const std::string& instanceId);
+
+        static std::string GetKey(const std::string& studyUid,
+                                  const std::string& seriesUid,
+                                  const std::string& instancesHash);
+    };
+}
+
+#endif
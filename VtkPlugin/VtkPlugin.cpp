@@ -3,13 +3,46 @@
 #include <vector>
 #include <cassert>
 #include <algorithm>
-#include <boost/regex.hpp>
-#include <boost/filesystem.hpp>
+#include <json/writer.h>
+#include <boost/thread.hpp>
 #include <OrthancCPlugin.h>
-#include <fstream>
+#include <memory>
 #include "dicomtoitk-1.0/dicomToItk.h"
+#include "SeriesFetcher.h"
+#include "SliceLayout.h"
+#include "MeshCache.h"
+#include "VolumeCache.h"
+#include "MeshFormats.h"
+#include "MeshOptions.h"
+#include "PrecomputeQueue.h"
+#include "InflightRequests.h"
+#include "JobScheduler.h"
 
-using namespace boost::filesystem;
+OrthancPluginContext*  context_ = NULL;
+
+static unsigned int fetchThreads_ = 4;
+static unsigned int decodeThreads_ = 4;
+static MeshEngine meshEngine_ = MeshEngine_MarchingCubes;
+static unsigned int meshThreads_ = 0;
+static unsigned int levelsOfDetail_ = 4;
+static bool outOfCore_ = false;
+static OrthancPlugins::ContentEncoding storedEncoding_ = OrthancPlugins::ContentEncoding_Gzip;
+static OrthancPlugins::MeshCache meshCache_(0);
+static OrthancPlugins::VolumeCache volumeCache_(0);
+static OrthancPlugins::InflightRequests inflightRequests_;
+static unsigned int precomputeThreads_ = 1;
+static bool precompute_ = false;
+
+static void PrecomputeSeries(const std::string& seriesId);
+static OrthancPlugins::PrecomputeQueue precomputeQueue_(PrecomputeSeries);
+
+static unsigned int maxConcurrentJobs_ = 2;
+static unsigned int maxPendingJobs_ = 32;
+static unsigned int maxCompletedJobs_ = 100;
+static size_t maxCompletedJobsSize_ = 256 * 1024 * 1024;
+
+static OrthancPlugins::CachedMeshPointer RunMeshJob(const OrthancPlugins::MeshJobParameters& parameters);
+static OrthancPlugins::JobScheduler jobScheduler_(RunMeshJob);
 
 
 void ToLowerCase(std::string& s)
@@ -63,44 +96,239 @@ void TokenizeString(std::vector<std::string> &result,
 result.push_back(currentItem);
 }
 
-void ParseContentType(std::string& application,
-                      std::map<std::string, std::string>& attributes,
-                      const std::string& header)
+void LogError(const std::string& message)
 {
-    application.clear();
-    attributes.clear();
+    OrthancPluginLogError(context_, message.c_str());
+}
 
-    std::vector<std::string> tokens;
-    TokenizeString(tokens, header, ';');
+void LogWarning(const std::string& message)
+{
+    OrthancPluginLogWarning(context_, message.c_str());
+}
 
-    assert(!tokens.empty());
-    application = tokens[0];
-    StripSpaces(application);
-    ToLowerCase(application);
+void LogInfo(const std::string& message)
+{
+    OrthancPluginLogInfo(context_, message.c_str());
+}
 
-    boost::regex pattern(R"(\s*([^=]+)\s*=\s*([^=]+)\s*)");
+static unsigned int GetUnsignedIntegerSetting(const Json::Value& section,
+                                              const std::string& key,
+                                              unsigned int defaultValue)
+{
+    if (section.type() != Json::objectValue ||
+        !section.isMember(key))
+    {
+        return defaultValue;
+    }
 
-    for (size_t i = 1; i < tokens.size(); i++)
+    const Json::Value& value = section[key];
+    if (value.type() != Json::intValue &&
+        value.type() != Json::uintValue)
     {
-        boost::cmatch what;
-        if (boost::regex_match(tokens[i].c_str(), what, pattern))
-        {
-            std::string key(what[1]);
-            std::string value(what[2]);
-            ToLowerCase(key);
-            attributes[key] = value;
-        }
+        LogError("The configuration option \"Vtk." + key + "\" must be a positive integer");
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_BadFileFormat);
     }
+
+    return value.asUInt();
 }
 
-void LogError(const std::string& message)
+static bool GetBooleanSetting(const Json::Value& section,
+                              const std::string& key,
+                              bool defaultValue)
 {
-    OrthancPluginLogError(context_, message.c_str());
+    if (section.type() != Json::objectValue ||
+        !section.isMember(key))
+    {
+        return defaultValue;
+    }
+
+    const Json::Value& value = section[key];
+    if (value.type() != Json::booleanValue)
+    {
+        LogError("The configuration option \"Vtk." + key + "\" must be a Boolean");
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_BadFileFormat);
+    }
+
+    return value.asBool();
 }
 
-void LogInfo(const std::string& message)
+static std::string GetStringSetting(const Json::Value& section,
+                                    const std::string& key,
+                                    const std::string& defaultValue)
 {
-    OrthancPluginLogInfo(context_, message.c_str());
+    if (section.type() != Json::objectValue ||
+        !section.isMember(key))
+    {
+        return defaultValue;
+    }
+
+    const Json::Value& value = section[key];
+    if (value.type() != Json::stringValue)
+    {
+        LogError("The configuration option \"Vtk." + key + "\" must be a string");
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_BadFileFormat);
+    }
+
+    return value.asString();
+}
+
+static const char* EnumerationToString(MeshEngine engine)
+{
+    switch (engine)
+    {
+        case MeshEngine_BinaryMask:
+            return "BinaryMask";
+
+        case MeshEngine_MarchingCubes:
+            return "MarchingCubes";
+
+        default:
+            throw OrthancPlugins::PluginException(OrthancPluginErrorCode_ParameterOutOfRange);
+    }
+}
+
+static MeshEngine StringToMeshEngine(const std::string& engine)
+{
+    if (engine == "BinaryMask")
+    {
+        return MeshEngine_BinaryMask;
+    }
+    else if (engine == "MarchingCubes")
+    {
+        return MeshEngine_MarchingCubes;
+    }
+    else
+    {
+        LogError("Unknown mesh engine \"" + engine + "\", must be \"MarchingCubes\" or \"BinaryMask\"");
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_BadFileFormat);
+    }
+}
+
+static void ReadConfiguration()
+{
+    Json::Value configuration;
+
+    {
+        char* tmp = OrthancPluginGetConfiguration(context_);
+        if (tmp == NULL)
+        {
+            LogError("Cannot read the configuration of Orthanc");
+            throw OrthancPlugins::PluginException(OrthancPluginErrorCode_InternalError);
+        }
+
+        Json::Reader reader;
+        bool ok = reader.parse(tmp, configuration);
+        OrthancPluginFreeString(context_, tmp);
+
+        if (!ok)
+        {
+            LogError("Unable to parse the configuration of Orthanc");
+            throw OrthancPlugins::PluginException(OrthancPluginErrorCode_BadFileFormat);
+        }
+    }
+
+    Json::Value vtk;
+    if (configuration.type() == Json::objectValue &&
+        configuration.isMember("Vtk"))
+    {
+        vtk = configuration["Vtk"];
+    }
+
+    unsigned int cores = boost::thread::hardware_concurrency();
+    if (cores == 0)
+    {
+        cores = 1;
+    }
+
+    fetchThreads_ = GetUnsignedIntegerSetting(vtk, "FetchThreads", 4);
+    decodeThreads_ = GetUnsignedIntegerSetting(vtk, "DecodeThreads", cores);
+
+    // "MarchingCubes" meshes on "MeshThreads" threads (0 for one per core),
+    // "BinaryMask" uses the single-threaded ITK filter
+    meshEngine_ = StringToMeshEngine(GetStringSetting(vtk, "MeshEngine", "MarchingCubes"));
+    meshThreads_ = GetUnsignedIntegerSetting(vtk, "MeshThreads", 0);
+
+    // Meshes the series slab by slab, fetching and decoding the instances of
+    // each slab right before meshing it, instead of building a volume first.
+    // Bounds the peak memory of large series, and always uses
+    // "MarchingCubes". Series whose slices cannot be laid out from the tags
+    // of Orthanc are still decoded whole, and "?stream=true" is refused for
+    // them with a 400.
+    outOfCore_ = GetBooleanSetting(vtk, "OutOfCore", false);
+
+    // Levels of the pyramid answered by "?lod=", each with a quarter of the
+    // triangles of the previous one, level 0 being the full mesh
+    levelsOfDetail_ = GetUnsignedIntegerSetting(vtk, "LevelsOfDetail", 4);
+    if (levelsOfDetail_ == 0)
+    {
+        levelsOfDetail_ = 1;
+    }
+
+    // In megabytes, 0 disables the cache
+    meshCache_.SetMaximumSize(static_cast<size_t>(GetUnsignedIntegerSetting(vtk, "MeshCacheSize", 256)) * 1024 * 1024);
+
+    // Decoded volumes kept to mesh series again with other parameters, in
+    // megabytes, 0 disabling the cache. Not used in out-of-core mode.
+    volumeCache_.SetMaximumSize(static_cast<size_t>(GetUnsignedIntegerSetting(vtk, "VolumeCacheSize", 1024)) * 1024 * 1024);
+
+    // Background workers meshing series as soon as they are stable, 0 disables them
+    precomputeThreads_ = GetUnsignedIntegerSetting(vtk, "PrecomputeThreads", 1);
+
+    // Meshing jobs submitted through the REST API. Jobs submitted while
+    // "MaxPendingJobs" are waiting get a 503, 0 disabling the limit. The
+    // results of finished jobs are kept up to "MaxCompletedJobsSize"
+    // megabytes, the oldest jobs being forgotten first.
+    maxConcurrentJobs_ = GetUnsignedIntegerSetting(vtk, "MaxConcurrentJobs", 2);
+    maxPendingJobs_ = GetUnsignedIntegerSetting(vtk, "MaxPendingJobs", 32);
+    maxCompletedJobs_ = GetUnsignedIntegerSetting(vtk, "MaxCompletedJobs", 100);
+    maxCompletedJobsSize_ = static_cast<size_t>(GetUnsignedIntegerSetting(vtk, "MaxCompletedJobsSize", 256)) * 1024 * 1024;
+
+    // Meshes are compressed once, when generated, and cached that way:
+    // "gzip", "deflate" or "identity" to disable compression. Only applies
+    // with "HttpCompressionEnabled" set to false in Orthanc.
+    const std::string compression = GetStringSetting(vtk, "Compression", "gzip");
+    if (!OrthancPlugins::LookupContentEncoding(storedEncoding_, compression))
+    {
+        LogError("Unknown compression \"" + compression + "\", must be \"gzip\", \"deflate\" or \"identity\"");
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_BadFileFormat);
+    }
+
+    // Orthanc would compress the answers of the plugin a second time. It
+    // does so unless the option is explicitly disabled.
+    if (storedEncoding_ != OrthancPlugins::ContentEncoding_Identity &&
+        GetBooleanSetting(configuration, "HttpCompressionEnabled", true))
+    {
+        LogWarning("Meshes are sent uncompressed, as \"HttpCompressionEnabled\" is enabled in Orthanc; "
+                   "set it to false for the plugin to cache and send compressed meshes");
+        storedEncoding_ = OrthancPlugins::ContentEncoding_Identity;
+    }
+}
+
+static OrthancPluginErrorCode OnChangeCallback(OrthancPluginChangeType changeType,
+                                               OrthancPluginResourceType resourceType,
+                                               const char* resourceId)
+{
+    if (precompute_ &&
+        changeType == OrthancPluginChangeType_StableSeries &&
+        resourceType == OrthancPluginResourceType_Series)
+    {
+        precomputeQueue_.Enqueue(resourceId);
+    }
+
+    // The volumes of a series that gains or loses an instance are stale
+    if (resourceType == OrthancPluginResourceType_Series &&
+        (changeType == OrthancPluginChangeType_NewChildInstance ||
+         changeType == OrthancPluginChangeType_Deleted))
+    {
+        volumeCache_.InvalidateSeries(resourceId);
+    }
+    else if (resourceType == OrthancPluginResourceType_Instance &&
+             changeType == OrthancPluginChangeType_Deleted)
+    {
+        volumeCache_.InvalidateInstance(resourceId);
+    }
+
+    return OrthancPluginErrorCode_Success;
 }
 
 extern "C"
@@ -109,7 +337,33 @@ extern "C"
 
         context_ = context;
 
+        try
+        {
+            ReadConfiguration();
+        }
+        catch (OrthancPlugins::PluginException&)
+        {
+            return -1;
+        }
+
         OrthancPlugins::RegisterRestCallback<GetVtk>(context, "/vtk/studies/([^/]*)/series/([^/]*)", true);
+        OrthancPlugins::RegisterRestCallback<PostJob>(context, "/vtk/studies/([^/]*)/series/([^/]*)/jobs", true);
+        OrthancPlugins::RegisterRestCallback<GetJob>(context, "/vtk/jobs/([^/]*)", true);
+        OrthancPlugins::RegisterRestCallback<GetJobResult>(context, "/vtk/jobs/([^/]*)/result", true);
+
+        jobScheduler_.Start(context, maxConcurrentJobs_, maxPendingJobs_, maxCompletedJobs_, maxCompletedJobsSize_);
+
+        precompute_ = (meshCache_.IsEnabled() && precomputeThreads_ > 0);
+        if (precompute_ || volumeCache_.IsEnabled())
+        {
+            OrthancPluginRegisterOnChangeCallback(context, OnChangeCallback);
+        }
+
+        if (precompute_)
+        {
+            precomputeQueue_.Start(precomputeThreads_);
+            LogInfo("Meshes of stable series are precomputed in the background");
+        }
 
         LogInfo("URI to VTK  API: /vtk/");
 
@@ -117,6 +371,8 @@ extern "C"
     }
 
     ORTHANC_PLUGINS_API void OrthancPluginFinalize() {
+        precomputeQueue_.Stop();
+        jobScheduler_.Stop();
     }
 
 
@@ -134,11 +390,6 @@ static bool LocateSeries(OrthancPluginRestOutput* output,
                          std::string& uri,
                          const OrthancPluginHttpRequest* request) {
 
-    if (request->method != OrthancPluginHttpMethod_Get) {
-        OrthancPluginSendMethodNotAllowed(context_, output, "GET");
-        return false;
-    }
-
     std::string id;
 
     {
@@ -205,57 +456,549 @@ static void AnswerListOfDicomInstances(OrthancPluginRestOutput* output,
     }
 }
 
-void GetVtk(OrthancPluginRestOutput *output, const char *url, const OrthancPluginHttpRequest *request) {
+// MD5 of the sorted instance IDs, which changes whenever an instance is
+// added to or removed from the series
+static std::string ComputeInstancesHash(std::vector<std::string> instances)
+{
+    std::sort(instances.begin(), instances.end());
 
-    LogInfo("Processing a VTK request");
-    std::string application;
+    std::string joined;
+    for (size_t i = 0; i < instances.size(); i++)
+    {
+        joined += instances[i];
+        joined += '|';
+    }
+
+    char* tmp = OrthancPluginComputeMd5(context_, joined.c_str(), static_cast<uint32_t>(joined.size()));
+    if (tmp == NULL)
+    {
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_InternalError);
+    }
+
+    std::string hash(tmp);
+    OrthancPluginFreeString(context_, tmp);
+    return hash;
+}
+
+static bool GetHttpHeader(std::string& value,
+                          const OrthancPluginHttpRequest* request,
+                          const std::string& header)
+{
+    for (uint32_t i = 0; i < request->headersCount; i++)
+    {
+        std::string key(request->headersKeys[i]);
+        ToLowerCase(key);
+        if (key == header)
+        {
+            value = request->headersValues[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Sends the mesh as it is cached if the client accepts its encoding,
+// otherwise re-encodes it for this answer only
+static void AnswerMesh(OrthancPluginRestOutput* output,
+                       const OrthancPluginHttpRequest* request,
+                       const OrthancPlugins::CachedMesh& mesh,
+                       const char* vary)
+{
+    std::string acceptEncoding;
+    GetHttpHeader(acceptEncoding, request, "accept-encoding");
+
+    OrthancPlugins::ContentEncoding encoding;
+    if (!OrthancPlugins::NegotiateContentEncoding(encoding, acceptEncoding, mesh.contentEncoding))
+    {
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_NotAcceptable);
+    }
+
+    std::string transcoded;
+    const std::string* content = &mesh.content;
+    if (encoding != mesh.contentEncoding)
+    {
+        OrthancPlugins::Transcode(transcoded, context_, mesh.content, mesh.contentEncoding, encoding);
+        content = &transcoded;
+    }
+
+    OrthancPluginSetHttpHeader(context_, output, "Vary", vary);
+    if (encoding != OrthancPlugins::ContentEncoding_Identity)
+    {
+        OrthancPluginSetHttpHeader(context_, output, "Content-Encoding", OrthancPlugins::EnumerationToString(encoding));
+    }
+
+    OrthancPluginAnswerBuffer(context_, output, content->empty() ? NULL : content->c_str(),
+                              static_cast<uint32_t>(content->size()), mesh.contentType.c_str());
+}
+
+// Wraps a freshly serialized mesh for the cache, compressing it once
+static OrthancPlugins::CachedMeshPointer PrepareMesh(std::string& content,
+                                                     const std::string& contentType)
+{
+    std::shared_ptr<OrthancPlugins::CachedMesh> mesh(new OrthancPlugins::CachedMesh);
+    mesh->contentType = contentType;
+
+    if (storedEncoding_ == OrthancPlugins::ContentEncoding_Identity)
+    {
+        mesh->content.swap(content);
+    }
+    else
+    {
+        OrthancPlugins::Transcode(mesh->content, context_, content,
+                                  OrthancPlugins::ContentEncoding_Identity, storedEncoding_);
+        mesh->contentEncoding = storedEncoding_;
+    }
+
+    return mesh;
+}
+
+static std::string GetCacheKey(const std::string& studyUid,
+                               const std::string& seriesUid,
+                               const std::string& instancesHash,
+                               const OrthancPlugins::MeshOptions& options)
+{
+    return OrthancPlugins::MeshCache::GetKey(
+            studyUid, seriesUid, instancesHash,
+            OrthancPlugins::FormatMeshOptions(options) + ";engine=" +
+            EnumerationToString(outOfCore_ ? MeshEngine_MarchingCubes : meshEngine_));
+}
+
+// Hands the volume of a series over to the generator, from the volume cache
+// if it is there, otherwise by downloading and decoding the instances, and
+// caching the volume if asked to. The out-of-core mode never builds volumes:
+// for generators meshing out of core, the instances of a laid out series are
+// only fetched and decoded slab by slab, as each slab gets meshed. Out of
+// core, series that cannot be laid out are refused for streaming rather
+// than decoded whole.
+static void LoadVolume(VtkGenerator& generator,
+                       const std::string& studyUid,
+                       const std::string& seriesUid,
+                       const std::string& seriesId,
+                       const std::string& instancesHash,
+                       const std::vector<std::string>& instances,
+                       unsigned int fetchThreads,
+                       unsigned int decodeThreads,
+                       bool cacheVolume,
+                       bool outOfCore,
+                       bool stream)
+{
+    const bool useCache = (!outOfCore_ && volumeCache_.IsEnabled());
+    const std::string key = OrthancPlugins::VolumeCache::GetKey(studyUid, seriesUid, instancesHash);
+
+    DecodedVolumePointer volume;
+    if (useCache &&
+        volumeCache_.Lookup(volume, key))
+    {
+        LogInfo("Using the cached volume of series " + seriesUid);
+        generator.setVolume(volume);
+        return;
+    }
+
+    // Orders the slices from the tags Orthanc has indexed, if it can
+    SliceLayout layout;
+    std::vector<std::string> sorted;
+    OrthancPlugins::SeriesFetcher fetcher(context_, fetchThreads, decodeThreads);
+    if (OrthancPlugins::LookupSliceLayout(layout, sorted, context_, seriesId, instances))
+    {
+        if (outOfCore)
+        {
+            // Every slab fetches and decodes its instances on the meshing
+            // thread that loads it, so there are never more fetches running
+            // than meshing threads. Slabs are loaded once per scan of the
+            // series, and more than 64 threshold ranges take several scans,
+            // each of which fetches the series again.
+            generator.setSliceSource(layout, [sorted](SliceSink& sink, size_t first, size_t last)
+            {
+                OrthancPlugins::SeriesFetcher slab(context_, 1, 1);
+                slab.Fetch(sink, sorted, first, last);
+            });
+            return;
+        }
+
+        generator.setLayout(layout);
+        fetcher.Fetch(generator, sorted, true);
+    }
+    else if (outOfCore && stream)
+    {
+        LogError("Series " + seriesUid + " cannot be streamed out of core, "
+                 "as its slices cannot be laid out from the tags of Orthanc");
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_BadRequest);
+    }
+    else
+    {
+        // Without a layout, the slices are only sorted once all decoded
+        fetcher.Fetch(generator, instances, false);
+    }
+
+    if (useCache && cacheVolume)
+    {
+        volume = generator.takeVolume();
+        if (!volume)
+        {
+            LogError("Cannot build the volume of series " + seriesUid);
+            throw OrthancPlugins::PluginException(OrthancPluginErrorCode_InternalError);
+        }
+
+        volumeCache_.Store(key, seriesId, instances, volume);
+    }
+}
+
+// Answers the mesh of a series from the cache, or generates and caches it.
+// Generating one level of the pyramid generates and caches all of them.
+// Background generations neither cache their volume nor share themselves
+// with concurrent requests, which would otherwise wait on their few workers.
+static OrthancPlugins::CachedMeshPointer GetMesh(const std::string& studyUid,
+                                                 const std::string& seriesUid,
+                                                 const std::string& seriesId,
+                                                 const std::vector<std::string>& instances,
+                                                 const OrthancPlugins::MeshOptions& options,
+                                                 unsigned int fetchThreads,
+                                                 unsigned int decodeThreads,
+                                                 bool background)
+{
+    const std::string instancesHash = ComputeInstancesHash(instances);
+    const std::string cacheKey = GetCacheKey(studyUid, seriesUid, instancesHash, options);
+
+    OrthancPlugins::CachedMeshPointer cached;
+    if (meshCache_.Lookup(cached, cacheKey))
+    {
+        LogInfo("Using the cached mesh of series " + seriesUid);
+        return cached;
+    }
+
+    // Every level of the pyramid comes out of the same generation
+    const unsigned int count = (options.pyramid ? levelsOfDetail_ : 1);
+    std::vector<std::string> levelKeys(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        OrthancPlugins::MeshOptions level = options;
+        level.lod = i;
+        levelKeys[i] = GetCacheKey(studyUid, seriesUid, instancesHash, level);
+    }
+
+    auto generate = [&]() -> OrthancPlugins::InflightRequests::Meshes
+    {
+        OrthancPlugins::InflightRequests::Meshes meshes(count);
+
+        bool finished = true;
+        for (unsigned int i = 0; i < count && finished; i++)
+        {
+            finished = meshCache_.Lookup(meshes[i], levelKeys[i]);
+        }
+
+        if (finished)
+        {
+            // Another request finished these meshes right before this one started
+            return meshes;
+        }
+
+        MeshFormat format;
+        if (!OrthancPlugins::LookupMeshFormat(format, options.contentType))
+        {
+            throw OrthancPlugins::PluginException(OrthancPluginErrorCode_ParameterOutOfRange);
+        }
+
+        VtkGenerator generator;
+        generator.setEngine(meshEngine_);
+        generator.setThreads(meshThreads_);
+        generator.setFormat(format);
+        generator.setPrecision(options.precision);
+        generator.setOutOfCore(outOfCore_);
+        generator.setTargetTriangles(options.targetTriangles);
+        generator.setReduction(options.reduction);
+        if (!options.ranges.empty())
+        {
+            generator.setThresholds(options.ranges);
+        }
+
+        LoadVolume(generator, studyUid, seriesUid, seriesId, instancesHash, instances,
+                   fetchThreads, decodeThreads, !background, outOfCore_, false);
+
+        // The meshes are serialized once, into these buffers, and answered from there
+        std::vector<std::string> levels(1);
+        if (options.pyramid ?
+            !generator.generateLevelsFromInstances(levels, count) :
+            !generator.generateFromInstances(levels[0]))
+        {
+            LogError("Cannot generate a mesh from series " + seriesUid);
+            throw OrthancPlugins::PluginException(OrthancPluginErrorCode_InternalError);
+        }
+        LogInfo("VTK Generator invoked");
+
+        for (size_t i = 0; i < count; i++)
+        {
+            meshes[i] = PrepareMesh(levels[i], options.contentType);
+            meshCache_.Store(levelKeys[i], meshes[i]);
+        }
+
+        return meshes;
+    };
+
+    if (background)
+    {
+        return generate()[options.lod];
+    }
+
+    // Concurrent requests for the same mesh share a single generation, and
+    // those for any level of the same pyramid share the whole pyramid
+    const std::string flightKey = (options.pyramid ? levelKeys[0] + ";pyramid" : cacheKey);
+    return inflightRequests_.Get(flightKey, generate)[options.lod];
+}
+
+// Sends the mesh as a multipart answer with one item per Z-slab, every
+// item going out as soon as its slab is meshed. A cached mesh is sent at
+// once, as a single item.
+static void StreamMesh(OrthancPluginRestOutput* output,
+                       const std::string& studyUid,
+                       const std::string& seriesUid,
+                       const std::string& seriesId,
+                       const std::vector<std::string>& instances,
+                       const OrthancPlugins::MeshOptions& options)
+{
+    MeshFormat format;
+    if (!OrthancPlugins::LookupMeshFormat(format, options.contentType))
+    {
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_ParameterOutOfRange);
+    }
+
+    const std::string instancesHash = ComputeInstancesHash(instances);
+
+    std::string cachedContent;
+    OrthancPlugins::CachedMeshPointer cached;
+    const bool isCached = meshCache_.Lookup(
+            cached, GetCacheKey(studyUid, seriesUid, instancesHash, options));
+
+    VtkGenerator generator;
+    if (isCached)
+    {
+        // Items of a multipart answer cannot have a Content-Encoding of their own
+        OrthancPlugins::Transcode(cachedContent, context_, cached->content,
+                                  cached->contentEncoding, OrthancPlugins::ContentEncoding_Identity);
+    }
+    else
+    {
+        generator.setThreads(meshThreads_);
+        generator.setFormat(format);
+        generator.setPrecision(options.precision);
+        generator.setOutOfCore(outOfCore_);
+        if (!options.ranges.empty())
+        {
+            generator.setThresholds(options.ranges);
+        }
+
+        LoadVolume(generator, studyUid, seriesUid, seriesId, instancesHash, instances,
+                   fetchThreads_, decodeThreads_, true, outOfCore_, true);
+    }
+
+    OrthancPluginSetHttpHeader(context_, output, "Vary", "Accept");
+    if (OrthancPluginStartMultipartAnswer(context_, output, "mixed", options.contentType.c_str()))
+    {
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_NetworkProtocol);
+    }
+
+    auto send = [&](const std::string& item)
+    {
+        if (OrthancPluginSendMultipartItem(context_, output, item.empty() ? NULL : item.c_str(),
+                                           static_cast<uint32_t>(item.size())) != OrthancPluginErrorCode_Success)
+        {
+            // The client has gone, stop meshing
+            throw OrthancPlugins::PluginException(OrthancPluginErrorCode_NetworkProtocol);
+        }
+    };
+
+    if (isCached)
+    {
+        LogInfo("Streaming the cached mesh of series " + seriesUid);
+        send(cachedContent);
+    }
+    else if (!generator.streamFromInstances(send))
+    {
+        LogError("Cannot stream a mesh from series " + seriesUid);
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_InternalError);
+    }
+}
+
+// Sends one mesh per threshold range as a multipart answer, in the order
+// of the ranges. Every range is cached under the key it has when requested
+// alone; the ranges missing from the cache are meshed in a single pass.
+static void AnswerRangeMeshes(OrthancPluginRestOutput* output,
+                              const std::string& studyUid,
+                              const std::string& seriesUid,
+                              const std::string& seriesId,
+                              const std::vector<std::string>& instances,
+                              const OrthancPlugins::MeshOptions& options)
+{
+    MeshFormat format;
+    if (!OrthancPlugins::LookupMeshFormat(format, options.contentType))
+    {
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_ParameterOutOfRange);
+    }
+
+    const std::string instancesHash = ComputeInstancesHash(instances);
+
+    std::vector<std::string> cacheKeys(options.ranges.size());
+    std::vector<OrthancPlugins::CachedMeshPointer> meshes(options.ranges.size());
+    std::vector<ThresholdRange> missing;
+    std::vector<size_t> missingIndexes;
+
+    for (size_t i = 0; i < options.ranges.size(); i++)
+    {
+        OrthancPlugins::MeshOptions single = options;
+        single.ranges.assign(1, options.ranges[i]);
+        cacheKeys[i] = GetCacheKey(studyUid, seriesUid, instancesHash, single);
+
+        if (!meshCache_.Lookup(meshes[i], cacheKeys[i]))
+        {
+            missing.push_back(options.ranges[i]);
+            missingIndexes.push_back(i);
+        }
+    }
+
+    if (!missing.empty())
+    {
+        VtkGenerator generator;
+        generator.setEngine(meshEngine_);
+        generator.setThreads(meshThreads_);
+        generator.setFormat(format);
+        generator.setPrecision(options.precision);
+        generator.setOutOfCore(outOfCore_);
+        generator.setTargetTriangles(options.targetTriangles);
+        generator.setReduction(options.reduction);
+        generator.setThresholds(missing);
+
+        LoadVolume(generator, studyUid, seriesUid, seriesId, instancesHash, instances,
+                   fetchThreads_, decodeThreads_, true, outOfCore_, false);
+
+        std::vector<std::string> contents;
+        if (!generator.generateFromInstances(contents))
+        {
+            LogError("Cannot generate the meshes of series " + seriesUid);
+            throw OrthancPlugins::PluginException(OrthancPluginErrorCode_InternalError);
+        }
+        LogInfo("VTK Generator invoked for " + std::to_string(missing.size()) + " ranges");
+
+        for (size_t i = 0; i < missingIndexes.size(); i++)
+        {
+            const size_t index = missingIndexes[i];
+            meshes[index] = PrepareMesh(contents[i], options.contentType);
+            meshCache_.Store(cacheKeys[index], meshes[index]);
+        }
+    }
+
+    OrthancPluginSetHttpHeader(context_, output, "Vary", "Accept");
+    if (OrthancPluginStartMultipartAnswer(context_, output, "mixed", options.contentType.c_str()))
+    {
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_NetworkProtocol);
+    }
+
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        // Items of a multipart answer cannot have a Content-Encoding of their own
+        std::string content;
+        OrthancPlugins::Transcode(content, context_, meshes[i]->content,
+                                  meshes[i]->contentEncoding, OrthancPlugins::ContentEncoding_Identity);
+
+        // Tells the client which range the item belongs to
+        const std::string range = OrthancPlugins::FormatThreshold(options.ranges[i].lower) + "-" +
+                                  OrthancPlugins::FormatThreshold(options.ranges[i].upper);
+        const char* keys[] = { "Content-Description" };
+        const char* values[] = { range.c_str() };
+
+        if (OrthancPluginSendMultipartItem2(context_, output, content.empty() ? NULL : content.c_str(),
+                                            static_cast<uint32_t>(content.size()), 1, keys, values) !=
+            OrthancPluginErrorCode_Success)
+        {
+            throw OrthancPlugins::PluginException(OrthancPluginErrorCode_NetworkProtocol);
+        }
+    }
+}
+
+static std::string GetRequestedContentType(const OrthancPluginHttpRequest *request)
+{
     std::string accept;
-    std::map<std::string, std::string> attributes;
-    ParseContentType(application, attributes, accept);
+    GetHttpHeader(accept, request, "accept");
+
     // Dispatch according to the requested content type
-    std::string returnContentType = "application/octet-stream";   // By default, JPEG image will be returned
-    if (!accept.empty())
+    std::string returnContentType;
+    if (!OrthancPlugins::NegotiateMeshFormat(returnContentType, accept))
     {
-        returnContentType = accept;
+        LogError("Unsupported VTK content type: " + accept);
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_NotAcceptable);
     }
 
+    return returnContentType;
+}
+
+static OrthancPlugins::MeshOptions GetRequestedMeshOptions(const OrthancPluginHttpRequest *request)
+{
+    OrthancPlugins::MeshOptions options;
+    options.contentType = GetRequestedContentType(request);
+
+    if (!OrthancPlugins::ParseMeshOptions(options, request))
+    {
+        LogError("Bad mesh arguments: expected at most one of a positive integer for \"targetTriangles\", "
+                 "a number in [0, 1) for \"reduction\", a level for \"lod\" or a boolean for \"stream\", "
+                 "and at most one of \"LOW-HIGH,...\" ranges for \"threshold\" or values for \"labels\", "
+                 "several of which exclude \"lod\" and \"stream\", and \"float32\" or \"quantized16\" "
+                 "for \"precision\"");
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_BadRequest);
+    }
+
+    if (options.lod >= levelsOfDetail_)
+    {
+        LogError("No level of detail " + std::to_string(options.lod) + ", the last one is " +
+                 std::to_string(levelsOfDetail_ - 1));
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_BadRequest);
+    }
+
+    return options;
+}
+
+static bool GetSeriesInstances(std::vector<std::string>& instances,
+                               const std::string& uri)
+{
+    Json::Value seriesResponse;
+    if (!OrthancPlugins::RestApiGetJson(seriesResponse, context_, uri, false))
+    {
+        return false;
+    }
+
+    instances.clear();
+    for (Json::Value::ArrayIndex i = 0; i < seriesResponse["Instances"].size(); ++i) {
+        instances.push_back(seriesResponse["Instances"][i].asString());
+    }
+
+    return true;
+}
+
+void GetVtk(OrthancPluginRestOutput *output, const char *url, const OrthancPluginHttpRequest *request) {
+
+    LogInfo("Processing a VTK request");
+
+    if (request->method != OrthancPluginHttpMethod_Get) {
+        OrthancPluginSendMethodNotAllowed(context_, output, "GET");
+        return;
+    }
+
+    const OrthancPlugins::MeshOptions options = GetRequestedMeshOptions(request);
+
     std::string uri;
-    char* tpm_name = std::tmpnam(nullptr);
-    path ph ( tpm_name );
+    std::vector<std::string> instances;
     if (LocateSeries(output, uri, request))
     {
         //AnswerListOfDicomInstances(output, uri);
-        Json::Value seriesResponse;
-
-        if (!OrthancPlugins::RestApiGetJson(seriesResponse, context_, uri, false))
+        if (!GetSeriesInstances(instances, uri))
         {
             OrthancPluginSendHttpStatusCode(context_, output, 404);
             return;
         }
 
-        if (seriesResponse["Instances"].empty())
+        if (instances.empty())
         {
             OrthancPluginSendHttpStatusCode(context_, output, 204);
             return;
         }
-
-        if (!exists(ph)) {
-            create_directories(ph);
-            LogInfo("Temp directory '" + ph.string() + "' created");
-        }
-        LogInfo("Using temp directory: '" + ph.string() + "' to store dicom files");
-
-        Json::Value instances = seriesResponse["Instances"];
-        for (int i = 0; i < instances.size(); ++i) {
-            OrthancPluginMemoryBuffer response;
-            OrthancPluginRestApiGet(context_, &response, std::string("/instances/" + instances[i].asString() + "/file").c_str());
-            std::string outName (ph.string() + "/" + instances[i].asString() + ".dicom");
-            std::ofstream outFile(outName, std::ofstream::binary);
-            outFile.write(reinterpret_cast<const char *>(response.data), response.size);
-            LogInfo(outName + " wrote");
-            outFile.close();
-            OrthancPluginFreeMemoryBuffer(context_, &response);
-        }
     }
     else
     {
@@ -264,54 +1007,185 @@ void GetVtk(OrthancPluginRestOutput *output, const char *url, const OrthancPlugi
         throw OrthancPlugins::PluginException(OrthancPluginErrorCode_UnknownResource);
     }
 
+    const std::string seriesId = uri.substr(std::string("/series/").size());
 
-    if (returnContentType == "application/octet-stream")
+    if (options.stream)
     {
-        //ifstream file ("test.vtk", std::ios::binary);
-        FILE * pFile;
-        long size;
-        char * buffer;
-        size_t result;
-        
-        std::string outFile = std::string("/out.vtk");
+        StreamMesh(output, request->groups[0], request->groups[1], seriesId, instances, options);
+        return;
+    }
 
-        VtkGenerator generator =  VtkGenerator(ph.c_str(), outFile.c_str());
-        LogInfo("VTK Generator constructor called with '" + ph.string() + "' path and '" + outFile + "'");
-        generator.generate();
-        LogInfo("VTK Generator invoked");
+    if (options.ranges.size() > 1)
+    {
+        AnswerRangeMeshes(output, request->groups[0], request->groups[1], seriesId, instances, options);
+        return;
+    }
 
-        const std::string outputFile =
-                ph.string().c_str() + std::string("/") + outFile;
+    OrthancPlugins::CachedMeshPointer mesh = GetMesh(request->groups[0], request->groups[1], seriesId, instances,
+                                                     options, fetchThreads_, decodeThreads_, false);
 
-        if ((pFile = fopen(outputFile.c_str(), "rb")) != nullptr)
-        {
-            fseek (pFile, 0, SEEK_END);   // non-portable
-            size = ftell (pFile);
-            printf ("Size of %s: %ld bytes.\n", outFile.c_str(), size);
-            rewind (pFile);
-            buffer = (char*) malloc (sizeof(char)*size);
+    // The format depends on the Accept header, so must the caches on the way
+    AnswerMesh(output, request, *mesh, "Accept, Accept-Encoding");
+}
 
-            if (buffer == nullptr) { fputs ("Memory error",stderr); exit (2); }
+static void AnswerJson(OrthancPluginRestOutput* output,
+                       const Json::Value& value)
+{
+    Json::StyledWriter writer;
+    const std::string s = writer.write(value);
+    OrthancPluginAnswerBuffer(context_, output, s.c_str(), static_cast<uint32_t>(s.size()), "application/json");
+}
 
-            result = fread (buffer, 1, static_cast<size_t>(size), pFile);
+static OrthancPlugins::CachedMeshPointer RunMeshJob(const OrthancPlugins::MeshJobParameters& parameters)
+{
+    std::vector<std::string> instances;
+    if (!GetSeriesInstances(instances, "/series/" + parameters.seriesId) ||
+        instances.empty())
+    {
+        LogError("Series " + parameters.seriesUid + " has no instance left to mesh");
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_UnknownResource);
+    }
 
-            if (result != size) {fputs ("Reading error",stderr); exit (3);}
+    return GetMesh(parameters.studyUid, parameters.seriesUid, parameters.seriesId, instances,
+                   parameters.options, fetchThreads_, decodeThreads_, false);
+}
 
-            OrthancPluginAnswerBuffer(context_, output, buffer, static_cast<uint32_t>(size), returnContentType.c_str());
-            fclose (pFile);
-            free (buffer);
+void PostJob(OrthancPluginRestOutput *output, const char *url, const OrthancPluginHttpRequest *request) {
 
-        }
-        else
+    if (request->method != OrthancPluginHttpMethod_Post) {
+        OrthancPluginSendMethodNotAllowed(context_, output, "POST");
+        return;
+    }
+
+    OrthancPlugins::MeshJobParameters parameters;
+    parameters.options = GetRequestedMeshOptions(request);
+    if (parameters.options.stream)
+    {
+        LogError("Mesh jobs cannot be streamed, download their result instead");
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_BadRequest);
+    }
+    if (parameters.options.ranges.size() > 1)
+    {
+        LogError("Mesh jobs mesh a single threshold range, submit one job per range");
+        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_BadRequest);
+    }
+    parameters.studyUid = request->groups[0];
+    parameters.seriesUid = request->groups[1];
+
+    std::string uri;
+    if (!LocateSeries(output, uri, request))
+    {
+        // LocateSeries() has already answered
+        return;
+    }
+
+    parameters.seriesId = uri.substr(std::string("/series/").size());
+
+    std::string id;
+    if (!jobScheduler_.Submit(id, parameters))
+    {
+        LogWarning("Too many pending mesh jobs, rejecting the one for series " + parameters.seriesUid);
+        OrthancPluginSendHttpStatusCode(context_, output, 503);
+        return;
+    }
+
+    LogInfo("Mesh job " + id + " submitted for series " + parameters.seriesUid);
+
+    Json::Value answer = Json::objectValue;
+    answer["ID"] = id;
+    answer["Path"] = "/vtk/jobs/" + id;
+    AnswerJson(output, answer);
+}
+
+void GetJob(OrthancPluginRestOutput *output, const char *url, const OrthancPluginHttpRequest *request) {
+
+    if (request->method != OrthancPluginHttpMethod_Get) {
+        OrthancPluginSendMethodNotAllowed(context_, output, "GET");
+        return;
+    }
+
+    Json::Value status;
+    if (jobScheduler_.GetStatus(status, request->groups[0]))
+    {
+        AnswerJson(output, status);
+    }
+    else
+    {
+        OrthancPluginSendHttpStatusCode(context_, output, 404);
+    }
+}
+
+void GetJobResult(OrthancPluginRestOutput *output, const char *url, const OrthancPluginHttpRequest *request) {
+
+    if (request->method != OrthancPluginHttpMethod_Get) {
+        OrthancPluginSendMethodNotAllowed(context_, output, "GET");
+        return;
+    }
+
+    OrthancPlugins::JobState state;
+    OrthancPluginErrorCode error;
+    OrthancPlugins::CachedMeshPointer mesh;
+    if (!jobScheduler_.GetResult(state, error, mesh, request->groups[0]))
+    {
+        OrthancPluginSendHttpStatusCode(context_, output, 404);
+        return;
+    }
+
+    switch (state)
+    {
+        case OrthancPlugins::JobState_Success:
+            AnswerMesh(output, request, *mesh, "Accept-Encoding");
+            break;
+
+        case OrthancPlugins::JobState_Failure:
+            throw OrthancPlugins::PluginException(error);
+
+        default:
+            // Accepted, but not finished yet
+            OrthancPluginSendHttpStatusCode(context_, output, 202);
+            break;
+    }
+}
+
+static void PrecomputeSeries(const std::string& seriesId)
+{
+    try
+    {
+        Json::Value series;
+        Json::Value study;
+        if (!OrthancPlugins::RestApiGetJson(series, context_, "/series/" + seriesId, false) ||
+            !OrthancPlugins::RestApiGetJson(study, context_, "/series/" + seriesId + "/study", false) ||
+            series["Instances"].empty())
         {
+            // The series was deleted in the meantime
+            return;
+        }
 
-            LogError("File not found: ");
-            throw OrthancPlugins::PluginException(OrthancPluginErrorCode_UnknownResource);
+        std::vector<std::string> instances;
+        for (Json::Value::ArrayIndex i = 0; i < series["Instances"].size(); ++i) {
+            instances.push_back(series["Instances"][i].asString());
         }
+
+        // The whole pyramid, so that viewers get any level from the cache
+        OrthancPlugins::MeshOptions options;
+        options.contentType = OrthancPlugins::GetDefaultMeshContentType();
+        options.pyramid = (levelsOfDetail_ > 1);
+
+        // A single fetch and decode worker, to stay out of the way of
+        // interactive requests, whose volumes are not evicted either. An
+        // interactive request for this series meanwhile generates the mesh
+        // on its own rather than waiting on this one.
+        GetMesh(study["MainDicomTags"]["StudyInstanceUID"].asString(),
+                series["MainDicomTags"]["SeriesInstanceUID"].asString(),
+                seriesId, instances, options, 1, 1, true);
     }
-    else
+    catch (OrthancPlugins::PluginException& e)
     {
-        LogError("Unsupported VTK content type: " + returnContentType);
-        throw OrthancPlugins::PluginException(OrthancPluginErrorCode_BadRequest);
+        LogError("Cannot precompute the mesh of series " + seriesId + ": " +
+                 std::string(OrthancPluginGetErrorDescription(context_, e.GetErrorCode())));
+    }
+    catch (...)
+    {
+        LogError("Cannot precompute the mesh of series " + seriesId);
     }
 }
@@ -6,6 +6,7 @@
 #include "cmake-build-debug/jsoncpp-0.10.5/include/json/reader.h"
 #include <boost/noncopyable.hpp>
 #include <string>
+#include <vector>
 
 namespace OrthancPlugins {
     typedef void (*RestCallback)(OrthancPluginRestOutput *output,
@@ -306,7 +307,7 @@ namespace OrthancPlugins {
         }
     }
 
-    bool RestApiGetJson(Json::Value& result,
+    inline bool RestApiGetJson(Json::Value& result,
                         OrthancPluginContext* context,
                         const std::string& uri,
                         bool applyPlugins)
@@ -324,7 +325,15 @@ namespace OrthancPlugins {
     }
 }
 
-OrthancPluginContext*  context_;
+extern OrthancPluginContext*  context_;
+
+void ToLowerCase(std::string& s);
+
+std::string StripSpaces(const std::string& source);
+
+void TokenizeString(std::vector<std::string> &result,
+                    const std::string &value,
+                    char separator);
 
 extern "C"
 {
@@ -339,4 +348,10 @@ extern "C"
 
 void GetVtk(OrthancPluginRestOutput *output, const char *url, const OrthancPluginHttpRequest *request);
 
+void PostJob(OrthancPluginRestOutput *output, const char *url, const OrthancPluginHttpRequest *request);
+
+void GetJob(OrthancPluginRestOutput *output, const char *url, const OrthancPluginHttpRequest *request);
+
+void GetJobResult(OrthancPluginRestOutput *output, const char *url, const OrthancPluginHttpRequest *request);
+
 #endif
\ No newline at end of file
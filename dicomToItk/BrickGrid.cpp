@@ -0,0 +1,97 @@
+#include "BrickGrid.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+template <typename PixelType>
+constexpr size_t BrickGrid<PixelType>::BrickSize;
+
+template <typename PixelType>
+BrickGrid<PixelType>::BrickGrid(const PixelType* voxels, const size_t size[3], unsigned int threads) {
+    for (unsigned int axis = 0; axis < 3; ++axis) {
+        counts[axis] = (size[axis] + BrickSize - 1) / BrickSize;
+    }
+
+    const size_t brickCount = counts[0] * counts[1] * counts[2];
+    minima.resize(brickCount);
+    maxima.resize(brickCount);
+
+    // A layer of bricks per task. The rows of voxels of each row of bricks
+    // are first folded into one, which vectorizes, then cut into bricks.
+    auto scanLayer = [&](size_t bk) {
+        std::vector<PixelType> rowMinima(size[0]);
+        std::vector<PixelType> rowMaxima(size[0]);
+        const size_t lastSlice = std::min(size[2], (bk + 1) * BrickSize);
+
+        for (size_t bj = 0; bj < counts[1]; ++bj) {
+            std::fill(rowMinima.begin(), rowMinima.end(), std::numeric_limits<PixelType>::max());
+            std::fill(rowMaxima.begin(), rowMaxima.end(), std::numeric_limits<PixelType>::lowest());
+
+            const size_t lastRow = std::min(size[1], (bj + 1) * BrickSize);
+            for (size_t k = bk * BrickSize; k < lastSlice; ++k) {
+                for (size_t j = bj * BrickSize; j < lastRow; ++j) {
+                    const PixelType* row = voxels + size[0] * (j + size[1] * k);
+                    for (size_t i = 0; i < size[0]; ++i) {
+                        rowMinima[i] = std::min(rowMinima[i], row[i]);
+                        rowMaxima[i] = std::max(rowMaxima[i], row[i]);
+                    }
+                }
+            }
+
+            for (size_t bi = 0; bi < counts[0]; ++bi) {
+                const size_t first = bi * BrickSize;
+                const size_t last = std::min(size[0], first + BrickSize);
+                const size_t b = bi + counts[0] * (bj + counts[1] * bk);
+                minima[b] = *std::min_element(rowMinima.begin() + first, rowMinima.begin() + last);
+                maxima[b] = *std::max_element(rowMaxima.begin() + first, rowMaxima.begin() + last);
+            }
+        }
+    };
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned int>(std::min<size_t>(threads, counts[2]));
+
+    std::atomic<size_t> next(0);
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+
+    auto worker = [&]() {
+        try {
+            for (size_t bk = next++; bk < counts[2]; bk = next++) {
+                scanLayer(bk);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(failureMutex);
+            failure = std::current_exception();
+            next = counts[2];
+        }
+    };
+
+    if (threads <= 1) {
+        worker();
+    } else {
+        std::vector<std::thread> pool;
+        for (unsigned int t = 0; t < threads; ++t) {
+            pool.emplace_back(worker);
+        }
+        for (std::thread& thread : pool) {
+            thread.join();
+        }
+    }
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+template class BrickGrid<uint8_t>;
+template class BrickGrid<int16_t>;
+template class BrickGrid<unsigned short>;
+template class BrickGrid<float>;
@@ -0,0 +1,43 @@
+#ifndef DICOMITKLIBRARY_BRICKGRID_H
+#define DICOMITKLIBRARY_BRICKGRID_H
+
+#include <cstddef>
+#include <vector>
+
+// Smallest and largest voxel value of every brick of BrickSize^3 voxels of
+// a volume, the bricks on the far sides holding what is left. A range of
+// values that no voxel of a brick lies in, or that holds all of them, does
+// not cross that brick, which lets the meshing skip most of a volume.
+template <typename PixelType>
+class BrickGrid {
+public:
+    static constexpr size_t BrickSize = 8;
+
+private:
+    size_t counts[3];
+    std::vector<PixelType> minima;
+    std::vector<PixelType> maxima;
+
+public:
+    // Scans the voxels of a volume of size[0] x size[1] x size[2] voxels, X
+    // first, on up to "threads" threads (0 meaning one per core).
+    BrickGrid(const PixelType* voxels, const size_t size[3], unsigned int threads);
+
+    size_t getCount(unsigned int axis) const {
+        return counts[axis];
+    }
+
+    PixelType getMinimum(size_t i, size_t j, size_t k) const {
+        return minima[i + counts[0] * (j + counts[1] * k)];
+    }
+
+    PixelType getMaximum(size_t i, size_t j, size_t k) const {
+        return maxima[i + counts[0] * (j + counts[1] * k)];
+    }
+
+    size_t getMemoryFootprint() const {
+        return (minima.size() + maxima.size()) * sizeof(PixelType);
+    }
+};
+
+#endif
@@ -0,0 +1,691 @@
+#include "Decimation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    // Triangles per partition. Like the slabs of the marching cubes, it
+    // must not depend on the number of threads.
+    constexpr size_t PartitionTriangles = 65536;
+    constexpr size_t MaxPartitions = 256;
+
+    // Smallest cosine allowed between the normals of a triangle before and
+    // after a collapse
+    constexpr double MinNormalCosine = 0.2;
+
+    // Symmetric 4x4 matrix of the sum of squared distances to a set of planes
+    struct Quadric {
+        double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+
+        Quadric() : xx(0), xy(0), xz(0), xw(0), yy(0), yz(0), yw(0), zz(0), zw(0), ww(0) {}
+
+        void addPlane(const double n[3], double d, double weight) {
+            xx += weight * n[0] * n[0];
+            xy += weight * n[0] * n[1];
+            xz += weight * n[0] * n[2];
+            xw += weight * n[0] * d;
+            yy += weight * n[1] * n[1];
+            yz += weight * n[1] * n[2];
+            yw += weight * n[1] * d;
+            zz += weight * n[2] * n[2];
+            zw += weight * n[2] * d;
+            ww += weight * d * d;
+        }
+
+        Quadric& operator+=(const Quadric& other) {
+            xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw;
+            yy += other.yy; yz += other.yz; yw += other.yw;
+            zz += other.zz; zw += other.zw;
+            ww += other.ww;
+            return *this;
+        }
+
+        double evaluate(const double p[3]) const {
+            const double x = p[0], y = p[1], z = p[2];
+            const double error = xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x
+                                 + yy * y * y + 2 * yz * y * z + 2 * yw * y
+                                 + zz * z * z + 2 * zw * z
+                                 + ww;
+            return std::max(0.0, error);
+        }
+
+        // Point of least error, if the quadric is not degenerate
+        bool minimize(double p[3]) const {
+            const double c00 = yy * zz - yz * yz;
+            const double c01 = xz * yz - xy * zz;
+            const double c02 = xy * yz - xz * yy;
+            const double det = xx * c00 + xy * c01 + xz * c02;
+
+            const double trace = (xx + yy + zz) / 3;
+            if (std::fabs(det) <= 1e-9 * trace * trace * trace) {
+                return false;
+            }
+
+            const double c11 = xx * zz - xz * xz;
+            const double c12 = xy * xz - xx * yz;
+            const double c22 = xx * yy - xy * xy;
+
+            p[0] = -(c00 * xw + c01 * yw + c02 * zw) / det;
+            p[1] = -(c01 * xw + c11 * yw + c12 * zw) / det;
+            p[2] = -(c02 * xw + c12 * yw + c22 * zw) / det;
+            return true;
+        }
+    };
+
+    void cross(const double a[3], const double b[3], const double c[3], double n[3]) {
+        const double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        const double v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        n[0] = u[1] * v[2] - u[2] * v[1];
+        n[1] = u[2] * v[0] - u[0] * v[2];
+        n[2] = u[0] * v[1] - u[1] * v[0];
+    }
+
+    double dot(const double a[3], const double b[3]) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    // The target position is not stored but computed again when the
+    // candidate is popped, which keeps the queue small
+    struct Candidate {
+        double cost;
+        uint32_t kept;
+        uint32_t removed;
+        uint32_t keptVersion;
+        uint32_t removedVersion;
+
+        // Heap order: the cheapest collapse on top, ties broken by index
+        bool operator<(const Candidate& other) const {
+            if (cost != other.cost) {
+                return cost > other.cost;
+            }
+            if (kept != other.kept) {
+                return kept > other.kept;
+            }
+            return removed > other.removed;
+        }
+    };
+
+    // Greedy edge collapse on the triangles of one partition. Vertices are
+    // renumbered locally; frozen vertices may be collapsed into, but never
+    // moved or removed.
+    class PartitionDecimator {
+    private:
+        std::vector<uint32_t> vertices;             // Global index of each local vertex, sorted
+        std::vector<double> positions;
+        std::vector<Quadric> quadrics;
+        std::vector<uint8_t> frozen;
+        std::vector<uint8_t> alive;
+        std::vector<uint32_t> versions;
+        std::vector<std::vector<uint32_t> > adjacency;   // Triangles around each vertex
+        std::vector<uint32_t> triangles;
+        std::vector<uint8_t> triangleAlive;
+        size_t aliveTriangles;
+        std::vector<Candidate> queue;               // Binary heap
+        std::vector<uint32_t> marks;                // Scratch stamps of the vertices
+        uint32_t stamp;
+
+        uint32_t toLocal(uint32_t global) const {
+            return static_cast<uint32_t>(std::lower_bound(vertices.begin(), vertices.end(), global) - vertices.begin());
+        }
+
+        const double* position(uint32_t v) const {
+            return &positions[3 * v];
+        }
+
+        bool contains(uint32_t t, uint32_t v) const {
+            const uint32_t* corners = &triangles[3 * t];
+            return corners[0] == v || corners[1] == v || corners[2] == v;
+        }
+
+        // Cost and target position of the collapse of edge (a, b). Returns
+        // false if both ends are frozen.
+        bool evaluate(uint32_t a, uint32_t b, Candidate& candidate, double target[3]) const {
+            if (frozen[a] && frozen[b]) {
+                return false;
+            }
+
+            candidate.kept = frozen[b] ? b : a;
+            candidate.removed = frozen[b] ? a : b;
+            candidate.keptVersion = versions[candidate.kept];
+            candidate.removedVersion = versions[candidate.removed];
+
+            Quadric quadric = quadrics[a];
+            quadric += quadrics[b];
+
+            const double* pa = position(candidate.kept);
+            const double* pb = position(candidate.removed);
+
+            if (frozen[candidate.kept]) {
+                std::copy(pa, pa + 3, target);
+                candidate.cost = quadric.evaluate(pa);
+                return true;
+            }
+
+            const double middle[3] = { (pa[0] + pb[0]) / 2, (pa[1] + pb[1]) / 2, (pa[2] + pb[2]) / 2 };
+            const double edge[3] = { pa[0] - pb[0], pa[1] - pb[1], pa[2] - pb[2] };
+
+            // Nearly degenerate quadrics may put the optimum far away
+            double optimum[3];
+            if (quadric.minimize(optimum)) {
+                const double offset[3] = { optimum[0] - middle[0], optimum[1] - middle[1], optimum[2] - middle[2] };
+                if (dot(offset, offset) <= dot(edge, edge)) {
+                    std::copy(optimum, optimum + 3, target);
+                    candidate.cost = quadric.evaluate(optimum);
+                    return true;
+                }
+            }
+
+            const double* choices[3] = { middle, pa, pb };
+            candidate.cost = -1;
+            for (const double* choice : choices) {
+                const double cost = quadric.evaluate(choice);
+                if (candidate.cost < 0 || cost < candidate.cost) {
+                    candidate.cost = cost;
+                    std::copy(choice, choice + 3, target);
+                }
+            }
+            return true;
+        }
+
+        void push(uint32_t a, uint32_t b) {
+            Candidate candidate;
+            double target[3];
+            if (evaluate(a, b, candidate, target)) {
+                queue.push_back(candidate);
+                std::push_heap(queue.begin(), queue.end());
+            }
+        }
+
+        // Rejects collapses that would pinch the surface into a non-manifold
+        // one, or fold a triangle over. The ends of the edge must share as
+        // many neighbours as there are triangles along the edge.
+        bool isValid(const Candidate& candidate, const double target[3]) {
+            const uint32_t kept = candidate.kept;
+            const uint32_t removed = candidate.removed;
+
+            stamp += 2;
+            for (uint32_t t : adjacency[kept]) {
+                for (unsigned int k = 0; k < 3; ++k) {
+                    marks[triangles[3 * t + k]] = stamp;
+                }
+            }
+
+            size_t common = 0;
+            size_t shared = 0;
+            for (uint32_t t : adjacency[removed]) {
+                if (contains(t, kept)) {
+                    ++shared;
+                }
+
+                for (unsigned int k = 0; k < 3; ++k) {
+                    const uint32_t w = triangles[3 * t + k];
+                    if (marks[w] == stamp) {
+                        ++common;
+                    } else if (frozen[kept] && frozen[w] && marks[w] != stamp + 1) {
+                        // The triangles of another partition may join w to
+                        // the kept vertex, out of sight of the link test
+                        return false;
+                    }
+                    marks[w] = stamp + 1;
+                }
+            }
+
+            // Both ends were counted among the common vertices
+            if (shared == 0 || common != shared + 2) {
+                return false;
+            }
+
+            // Closed pieces as small as a tetrahedron would fold flat
+            if (!frozen[kept] && adjacency[kept].size() + adjacency[removed].size() < 2 * shared + 3) {
+                return false;
+            }
+
+            for (uint32_t v : { kept, removed }) {
+                for (uint32_t t : adjacency[v]) {
+                    if (contains(t, kept) && contains(t, removed)) {
+                        continue;   // Disappears with the collapse
+                    }
+
+                    const uint32_t* corners = &triangles[3 * t];
+                    const double* before[3];
+                    const double* after[3];
+                    for (unsigned int k = 0; k < 3; ++k) {
+                        before[k] = position(corners[k]);
+                        after[k] = (corners[k] == v ? target : before[k]);
+                    }
+
+                    double n0[3], n1[3];
+                    cross(before[0], before[1], before[2], n0);
+                    cross(after[0], after[1], after[2], n1);
+
+                    const double norms = std::sqrt(dot(n0, n0) * dot(n1, n1));
+                    if (norms <= 0 || dot(n0, n1) < MinNormalCosine * norms) {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        void collapse(const Candidate& candidate, const double target[3]) {
+            const uint32_t kept = candidate.kept;
+            const uint32_t removed = candidate.removed;
+
+            for (uint32_t t : adjacency[removed]) {
+                uint32_t* corners = &triangles[3 * t];
+                if (contains(t, kept)) {
+                    triangleAlive[t] = 0;
+                    --aliveTriangles;
+
+                    for (unsigned int k = 0; k < 3; ++k) {
+                        if (corners[k] != kept && corners[k] != removed) {
+                            std::vector<uint32_t>& third = adjacency[corners[k]];
+                            third.erase(std::find(third.begin(), third.end(), t));
+                        }
+                    }
+                } else {
+                    for (unsigned int k = 0; k < 3; ++k) {
+                        if (corners[k] == removed) {
+                            corners[k] = kept;
+                        }
+                    }
+                    adjacency[kept].push_back(t);
+                }
+            }
+
+            std::vector<uint32_t>& around = adjacency[kept];
+            around.erase(std::remove_if(around.begin(), around.end(),
+                                        [this](uint32_t t) { return !triangleAlive[t]; }),
+                         around.end());
+
+            std::copy(target, target + 3, &positions[3 * kept]);
+            quadrics[kept] += quadrics[removed];
+
+            alive[removed] = 0;
+            std::vector<uint32_t>().swap(adjacency[removed]);
+            ++versions[kept];
+            ++versions[removed];
+        }
+
+    public:
+        PartitionDecimator(const TriangleMesh& mesh,
+                           const std::vector<uint32_t>& partitionTriangles,
+                           const std::vector<uint8_t>& frozenVertices) : stamp(0) {
+            for (uint32_t t : partitionTriangles) {
+                vertices.insert(vertices.end(), &mesh.triangles[3 * t], &mesh.triangles[3 * t] + 3);
+            }
+            std::sort(vertices.begin(), vertices.end());
+            vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+            const size_t count = vertices.size();
+            positions.resize(3 * count);
+            quadrics.resize(count);
+            frozen.resize(count);
+            alive.assign(count, 1);
+            versions.assign(count, 0);
+            adjacency.resize(count);
+            marks.assign(count, 0);
+
+            for (size_t v = 0; v < count; ++v) {
+                for (unsigned int k = 0; k < 3; ++k) {
+                    positions[3 * v + k] = mesh.points[3 * vertices[v] + k];
+                }
+                frozen[v] = frozenVertices[vertices[v]];
+            }
+
+            triangles.resize(3 * partitionTriangles.size());
+            for (size_t i = 0; i < partitionTriangles.size(); ++i) {
+                for (unsigned int k = 0; k < 3; ++k) {
+                    triangles[3 * i + k] = toLocal(mesh.triangles[3 * partitionTriangles[i] + k]);
+                    adjacency[triangles[3 * i + k]].push_back(static_cast<uint32_t>(i));
+                }
+            }
+            triangleAlive.assign(partitionTriangles.size(), 1);
+            aliveTriangles = partitionTriangles.size();
+
+            // Planes weighted by the area of their triangle
+            for (size_t i = 0; i < partitionTriangles.size(); ++i) {
+                const uint32_t* corners = &triangles[3 * i];
+                double n[3];
+                cross(position(corners[0]), position(corners[1]), position(corners[2]), n);
+
+                const double length = std::sqrt(dot(n, n));
+                if (length <= 0) {
+                    continue;
+                }
+
+                const double unit[3] = { n[0] / length, n[1] / length, n[2] / length };
+                const double d = -dot(unit, position(corners[0]));
+                for (unsigned int k = 0; k < 3; ++k) {
+                    quadrics[corners[k]].addPlane(unit, d, length / 2);
+                }
+            }
+        }
+
+        size_t getTriangleCount() const {
+            return aliveTriangles;
+        }
+
+        void decimate(size_t target) {
+            // Each edge once, from the triangle that runs along it upwards
+            Candidate candidate;
+            double position[3];
+            queue.reserve(3 * triangleAlive.size() / 2);
+            for (size_t i = 0; i < triangleAlive.size(); ++i) {
+                for (unsigned int k = 0; k < 3; ++k) {
+                    const uint32_t a = triangles[3 * i + k];
+                    const uint32_t b = triangles[3 * i + (k + 1) % 3];
+                    if (a < b && evaluate(a, b, candidate, position)) {
+                        queue.push_back(candidate);
+                    }
+                }
+            }
+            std::make_heap(queue.begin(), queue.end());
+
+            std::vector<uint32_t> around;
+            while (aliveTriangles > target && !queue.empty()) {
+                std::pop_heap(queue.begin(), queue.end());
+                const Candidate popped = queue.back();
+                queue.pop_back();
+
+                if (!alive[popped.kept] || !alive[popped.removed] ||
+                    versions[popped.kept] != popped.keptVersion ||
+                    versions[popped.removed] != popped.removedVersion) {
+                    continue;   // Outdated
+                }
+
+                evaluate(popped.kept, popped.removed, candidate, position);
+                if (!isValid(candidate, position)) {
+                    continue;
+                }
+
+                collapse(candidate, position);
+
+                // The costs of the edges around the kept vertex changed
+                stamp += 2;
+                around.clear();
+                for (uint32_t t : adjacency[candidate.kept]) {
+                    for (unsigned int k = 0; k < 3; ++k) {
+                        const uint32_t w = triangles[3 * t + k];
+                        if (w != candidate.kept && marks[w] != stamp) {
+                            marks[w] = stamp;
+                            around.push_back(w);
+                        }
+                    }
+                }
+                for (uint32_t w : around) {
+                    push(candidate.kept, w);
+                }
+            }
+
+            std::vector<Candidate>().swap(queue);
+        }
+
+        // Moves the surviving vertices, which belong to this partition only
+        // unless frozen, and appends the surviving triangles
+        void store(TriangleMesh& mesh, std::vector<uint32_t>& target) const {
+            for (size_t v = 0; v < vertices.size(); ++v) {
+                if (alive[v] && !frozen[v]) {
+                    for (unsigned int k = 0; k < 3; ++k) {
+                        mesh.points[3 * vertices[v] + k] = static_cast<float>(positions[3 * v + k]);
+                    }
+                }
+            }
+
+            target.clear();
+            target.reserve(3 * aliveTriangles);
+            for (size_t i = 0; i < triangleAlive.size(); ++i) {
+                if (triangleAlive[i]) {
+                    for (unsigned int k = 0; k < 3; ++k) {
+                        target.push_back(vertices[triangles[3 * i + k]]);
+                    }
+                }
+            }
+        }
+    };
+
+    template <typename Task>
+    void runParallel(size_t count, unsigned int threads, const Task& task) {
+        std::atomic<size_t> next(0);
+        std::exception_ptr failure;
+        std::mutex failureMutex;
+
+        auto worker = [&]() {
+            try {
+                for (size_t i = next++; i < count; i = next++) {
+                    task(i);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(failureMutex);
+                failure = std::current_exception();
+                next = count;
+            }
+        };
+
+        threads = static_cast<unsigned int>(std::min<size_t>(threads, count));
+        if (threads <= 1) {
+            worker();
+        } else {
+            std::vector<std::thread> pool;
+            for (unsigned int t = 0; t < threads; ++t) {
+                pool.emplace_back(worker);
+            }
+            for (std::thread& thread : pool) {
+                thread.join();
+            }
+        }
+
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    // One round of decimation over "partitionCount" slices of the longest
+    // axis, shifted by "shift" slice widths
+    void decimateRound(TriangleMesh& mesh, size_t target, size_t partitionCount, double shift, unsigned int threads) {
+        const size_t triangleCount = mesh.getTriangleCount();
+
+        float minimum[3] = { mesh.points[0], mesh.points[1], mesh.points[2] };
+        float maximum[3] = { mesh.points[0], mesh.points[1], mesh.points[2] };
+        for (size_t i = 0; i < mesh.points.size(); i += 3) {
+            for (unsigned int k = 0; k < 3; ++k) {
+                minimum[k] = std::min(minimum[k], mesh.points[i + k]);
+                maximum[k] = std::max(maximum[k], mesh.points[i + k]);
+            }
+        }
+
+        unsigned int axis = 0;
+        for (unsigned int k = 1; k < 3; ++k) {
+            if (maximum[k] - minimum[k] > maximum[axis] - minimum[axis]) {
+                axis = k;
+            }
+        }
+
+        const double width = std::max(1e-12, static_cast<double>(maximum[axis] - minimum[axis]) / partitionCount);
+        const size_t slots = (shift > 0 ? partitionCount + 1 : partitionCount);
+
+        std::vector<std::vector<uint32_t> > partitions(slots);
+        std::vector<uint32_t> owner(mesh.getPointCount(), 0xffffffffu);
+        std::vector<uint8_t> frozen(mesh.getPointCount(), 0);
+
+        for (size_t t = 0; t < triangleCount; ++t) {
+            const uint32_t* corners = &mesh.triangles[3 * t];
+            const double centre = (static_cast<double>(mesh.points[3 * corners[0] + axis]) +
+                                   mesh.points[3 * corners[1] + axis] +
+                                   mesh.points[3 * corners[2] + axis]) / 3;
+
+            const double slot = std::floor((centre - minimum[axis]) / width + shift);
+            const uint32_t p = static_cast<uint32_t>(std::min<double>(std::max(0.0, slot), static_cast<double>(slots - 1)));
+            partitions[p].push_back(static_cast<uint32_t>(t));
+
+            for (unsigned int k = 0; k < 3; ++k) {
+                uint32_t& o = owner[corners[k]];
+                if (o == 0xffffffffu) {
+                    o = p;
+                } else if (o != p) {
+                    frozen[corners[k]] = 1;
+                }
+            }
+        }
+
+        // Vertices on an open boundary stay where they are, so that holes
+        // neither grow nor close
+        {
+            std::vector<std::pair<uint32_t, uint32_t> > edges;
+            edges.reserve(3 * triangleCount);
+            for (size_t t = 0; t < triangleCount; ++t) {
+                for (unsigned int k = 0; k < 3; ++k) {
+                    const uint32_t a = mesh.triangles[3 * t + k];
+                    const uint32_t b = mesh.triangles[3 * t + (k + 1) % 3];
+                    edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+                }
+            }
+            std::sort(edges.begin(), edges.end());
+
+            for (size_t i = 0; i < edges.size();) {
+                size_t j = i + 1;
+                while (j < edges.size() && edges[j] == edges[i]) {
+                    ++j;
+                }
+                if (j - i == 1) {
+                    frozen[edges[i].first] = 1;
+                    frozen[edges[i].second] = 1;
+                }
+                i = j;
+            }
+        }
+
+        std::vector<std::vector<uint32_t> > results(slots);
+        runParallel(slots, threads, [&](size_t p) {
+            if (partitions[p].empty()) {
+                return;
+            }
+
+            PartitionDecimator decimator(mesh, partitions[p], frozen);
+            std::vector<uint32_t>().swap(partitions[p]);
+
+            // Budget in proportion to the size of the partition
+            const size_t budget = static_cast<size_t>(static_cast<double>(decimator.getTriangleCount()) * target / triangleCount);
+            decimator.decimate(budget);
+            decimator.store(mesh, results[p]);
+        });
+
+        size_t total = 0;
+        for (const std::vector<uint32_t>& result : results) {
+            total += result.size();
+        }
+
+        std::vector<uint32_t> triangles;
+        triangles.reserve(total);
+        for (std::vector<uint32_t>& result : results) {
+            triangles.insert(triangles.end(), result.begin(), result.end());
+            std::vector<uint32_t>().swap(result);
+        }
+        mesh.triangles.swap(triangles);
+    }
+
+    // Drops the points that no triangle uses any more, keeping their order
+    void removeUnusedPoints(TriangleMesh& mesh) {
+        std::vector<uint32_t> remap(mesh.getPointCount(), 0);
+        for (uint32_t v : mesh.triangles) {
+            remap[v] = 1;
+        }
+
+        uint32_t next = 0;
+        for (size_t v = 0; v < remap.size(); ++v) {
+            if (remap[v]) {
+                std::copy(&mesh.points[3 * v], &mesh.points[3 * v] + 3, &mesh.points[3 * next]);
+                remap[v] = next++;
+            }
+        }
+
+        mesh.points.resize(3 * next);
+        for (uint32_t& v : mesh.triangles) {
+            v = remap[v];
+        }
+    }
+
+    void removeDegenerateTriangles(TriangleMesh& mesh) {
+        size_t next = 0;
+        for (size_t t = 0; t < mesh.getTriangleCount(); ++t) {
+            const uint32_t a = mesh.triangles[3 * t];
+            const uint32_t b = mesh.triangles[3 * t + 1];
+            const uint32_t c = mesh.triangles[3 * t + 2];
+            if (a != b && b != c && a != c) {
+                mesh.triangles[3 * next] = a;
+                mesh.triangles[3 * next + 1] = b;
+                mesh.triangles[3 * next + 2] = c;
+                ++next;
+            }
+        }
+        mesh.triangles.resize(3 * next);
+    }
+}
+
+void decimateMesh(TriangleMesh& mesh, size_t targetTriangles, unsigned int threads) {
+    removeDegenerateTriangles(mesh);
+
+    const size_t initial = mesh.getTriangleCount();
+    if (initial <= targetTriangles || mesh.points.empty()) {
+        return;
+    }
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    const bool normals = mesh.hasNormals();
+    mesh.normals.clear();
+
+    const size_t partitionCount = std::min(MaxPartitions, initial / PartitionTriangles);
+    if (partitionCount > 1) {
+        // Halfway to the target with the seams of the first partitioning
+        // frozen, then almost to the target with seams in between. The
+        // sequential round unfreezes the last seams.
+        const double ratio = static_cast<double>(targetTriangles) / initial;
+        const size_t halfway = static_cast<size_t>(initial * std::sqrt(ratio));
+        const size_t almost = targetTriangles + (halfway - targetTriangles) / 16;
+
+        decimateRound(mesh, halfway, partitionCount, 0.0, threads);
+        decimateRound(mesh, almost, partitionCount, 0.5, threads);
+    }
+
+    if (mesh.getTriangleCount() > targetTriangles) {
+        decimateRound(mesh, targetTriangles, 1, 0.0, 1);
+    }
+
+    removeUnusedPoints(mesh);
+    mesh.shrinkToFit();
+
+    if (normals) {
+        mesh.computeNormals();
+    }
+}
+
+void decimateLevels(std::vector<TriangleMesh>& levels, const TriangleMesh& mesh,
+                    unsigned int count, double ratio, unsigned int threads) {
+    levels.clear();
+    if (count == 0) {
+        return;
+    }
+
+    levels.reserve(count);
+    levels.push_back(mesh);
+
+    for (unsigned int i = 1; i < count; ++i) {
+        // Each level goes on from where the previous one stopped, so the
+        // whole pyramid costs little more than decimating to its first level
+        TriangleMesh level = levels.back();
+        const size_t target = static_cast<size_t>(static_cast<double>(level.getTriangleCount()) * ratio);
+        decimateMesh(level, std::max<size_t>(target, 1), threads);
+        levels.push_back(std::move(level));
+    }
+}
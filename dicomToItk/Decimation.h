@@ -0,0 +1,24 @@
+#ifndef DICOMITKLIBRARY_DECIMATION_H
+#define DICOMITKLIBRARY_DECIMATION_H
+
+#include <cstddef>
+#include <vector>
+#include "TriangleMesh.h"
+
+// Simplifies the mesh by quadric error edge collapses until it has at most
+// "targetTriangles" triangles, or until no collapse is left that keeps the
+// surface manifold and its triangles unflipped. The mesh is cut into
+// partitions along its longest axis that are decimated on up to "threads"
+// threads (0 meaning one per core), the vertices shared by two partitions
+// being frozen. Successive rounds shift the partitions so that every seam
+// gets decimated, and a last sequential round reaches the exact target. The
+// output does not depend on the number of threads.
+void decimateMesh(TriangleMesh& mesh, size_t targetTriangles, unsigned int threads);
+
+// Builds "count" levels of detail of the mesh, level 0 being a copy of the
+// mesh and every next level being decimated from the previous one down to
+// "ratio" times its triangles.
+void decimateLevels(std::vector<TriangleMesh>& levels, const TriangleMesh& mesh,
+                    unsigned int count, double ratio, unsigned int threads);
+
+#endif
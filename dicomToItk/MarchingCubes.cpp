@@ -0,0 +1,1126 @@
+#include "MarchingCubes.h"
+#include "PackedMask.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+    constexpr uint32_t NoVertex = 0xffffffffu;
+
+    // Thickness of the Z-slabs, in cell layers. It must not depend on the
+    // number of threads, otherwise the output would.
+    constexpr size_t SlabLayers = 16;
+
+    // A cube has at most 12 crossed edges, and every loop of n crossed edges
+    // gives n - 2 triangles, hence at most 10 triangles per cube
+    constexpr unsigned int MaxCaseTriangles = 10;
+
+    // Corner c of a cube sits at (c & 1, (c >> 1) & 1, (c >> 2) & 1). An edge
+    // is given by its lowest corner and by the axis it runs along.
+    struct CubeEdge {
+        unsigned int corner;
+        unsigned int axis;
+    };
+
+    const CubeEdge cubeEdges[12] = {
+            {0, 0}, {2, 0}, {4, 0}, {6, 0},
+            {0, 1}, {1, 1}, {4, 1}, {5, 1},
+            {0, 2}, {1, 2}, {2, 2}, {3, 2}
+    };
+
+    struct CaseTable {
+        uint8_t triangleCount[256];
+        uint8_t edges[256][3 * MaxCaseTriangles];
+    };
+
+    unsigned int findEdge(unsigned int a, unsigned int b) {
+        const unsigned int low = std::min(a, b);
+        const unsigned int axis = (std::max(a, b) - low == 1 ? 0 : (std::max(a, b) - low == 2 ? 1 : 2));
+
+        for (unsigned int e = 0; e < 12; ++e) {
+            if (cubeEdges[e].corner == low && cubeEdges[e].axis == axis) {
+                return e;
+            }
+        }
+
+        return 12;  // Not reached for adjacent corners
+    }
+
+    // Whether two edges of a cube lie in a common face
+    bool shareFace(unsigned int a, unsigned int b) {
+        for (unsigned int axis = 0; axis < 3; ++axis) {
+            if (cubeEdges[a].axis != axis && cubeEdges[b].axis != axis &&
+                ((cubeEdges[a].corner >> axis) & 1) == ((cubeEdges[b].corner >> axis) & 1)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Triangulates a loop of crossed edges without any diagonal between two
+    // edges of a same face. A loop may cross an ambiguous face twice, and a
+    // diagonal in that face would give a triangle that the neighbouring
+    // cube also emits with the opposite winding: a double sheet whose edges
+    // have four triangles. Feasible sub-polygons [i, j] of the loop are
+    // worked out from the smallest up, then unfolded from the whole loop.
+    unsigned int triangulateLoop(const unsigned int* loop, unsigned int length, uint8_t* target) {
+        // split[i][j] is the apex of the triangle on the chord (i, j), or 0 if
+        // the sub-polygon from i to j cannot be triangulated
+        unsigned int split[12][12] = {};
+        auto allowed = [&](unsigned int i, unsigned int j) {
+            return j == i + 1 || (i == 0 && j == length - 1) || !shareFace(loop[i], loop[j]);
+        };
+        auto feasible = [&](unsigned int i, unsigned int j) {
+            return j == i + 1 || split[i][j] != 0;
+        };
+
+        for (unsigned int span = 2; span < length; ++span) {
+            for (unsigned int i = 0; i + span < length; ++i) {
+                const unsigned int j = i + span;
+                for (unsigned int k = i + 1; k < j && split[i][j] == 0; ++k) {
+                    if (allowed(i, k) && allowed(k, j) && feasible(i, k) && feasible(k, j)) {
+                        split[i][j] = k;
+                    }
+                }
+            }
+        }
+
+        if (split[0][length - 1] == 0) {
+            throw std::logic_error("No triangulation of a marching cubes loop keeps out of the faces");
+        }
+
+        unsigned int count = 0;
+        unsigned int stack[48];
+        unsigned int depth = 0;
+        stack[depth++] = 0;
+        stack[depth++] = length - 1;
+        while (depth > 0) {
+            const unsigned int j = stack[--depth];
+            const unsigned int i = stack[--depth];
+            if (j <= i + 1) {
+                continue;
+            }
+
+            const unsigned int k = split[i][j];
+            target[3 * count] = static_cast<uint8_t>(loop[i]);
+            target[3 * count + 1] = static_cast<uint8_t>(loop[k]);
+            target[3 * count + 2] = static_cast<uint8_t>(loop[j]);
+            ++count;
+
+            stack[depth++] = i;
+            stack[depth++] = k;
+            stack[depth++] = k;
+            stack[depth++] = j;
+        }
+
+        return count;
+    }
+
+    // Builds the triangulation of the 256 cube configurations instead of
+    // hardcoding it. On every face, each crossed edge entered from outside is
+    // joined to the next crossed edge left towards outside, counter-clockwise
+    // as seen from outside the cube. Ambiguous faces thus always keep their
+    // inside corners apart, which only depends on the face itself, so that
+    // neighbouring cubes agree and the surface is watertight. The segments
+    // close into loops around the cube, which are triangulated without
+    // diagonals in the faces and come out facing away from the inside
+    // corners.
+    CaseTable buildCaseTable() {
+        unsigned int faces[6][4];
+        for (unsigned int a = 0; a < 3; ++a) {
+            const unsigned int u = (a + 1) % 3;
+            const unsigned int v = (a + 2) % 3;
+            const unsigned int square[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+
+            for (unsigned int side = 0; side < 2; ++side) {
+                unsigned int* face = faces[2 * a + side];
+                for (unsigned int k = 0; k < 4; ++k) {
+                    // Counter-clockwise around +a, reversed for the face looking towards -a
+                    const unsigned int* uv = square[side == 1 ? k : 3 - k];
+                    face[k] = (side << a) | (uv[0] << u) | (uv[1] << v);
+                }
+            }
+        }
+
+        CaseTable table;
+        for (unsigned int cube = 0; cube < 256; ++cube) {
+            int next[12];
+            std::fill(next, next + 12, -1);
+
+            for (const unsigned int* face : faces) {
+                bool inside[4];
+                for (unsigned int k = 0; k < 4; ++k) {
+                    inside[k] = ((cube >> face[k]) & 1) != 0;
+                }
+
+                for (unsigned int k = 0; k < 4; ++k) {
+                    if (inside[k] || !inside[(k + 1) % 4]) {
+                        continue;
+                    }
+
+                    for (unsigned int j = k + 1; j < k + 4; ++j) {
+                        if (inside[j % 4] && !inside[(j + 1) % 4]) {
+                            next[findEdge(face[k], face[(k + 1) % 4])] = findEdge(face[j % 4], face[(j + 1) % 4]);
+                            break;
+                        }
+                    }
+                }
+            }
+
+            bool visited[12] = {false};
+            unsigned int count = 0;
+            for (unsigned int e = 0; e < 12; ++e) {
+                if (next[e] < 0 || visited[e]) {
+                    continue;
+                }
+
+                unsigned int loop[12];
+                unsigned int length = 0;
+                for (int current = e; !visited[current]; current = next[current]) {
+                    visited[current] = true;
+                    loop[length++] = current;
+                }
+
+                count += triangulateLoop(loop, length, &table.edges[cube][3 * count]);
+            }
+
+            table.triangleCount[cube] = count;
+        }
+
+        return table;
+    }
+
+    const CaseTable& getCaseTable() {
+        static const CaseTable table = buildCaseTable();
+        return table;
+    }
+
+    typedef std::vector<std::pair<uint32_t, uint32_t> > Seam;    // Edge key in its plane, vertex index
+
+    struct Slab {
+        std::vector<float> points;
+        std::vector<uint32_t> triangles;
+        Seam bottom;
+        Seam top;
+    };
+
+    // A bit per range tells whether a voxel lies in that range, hence at most
+    // 64 ranges per scan of the volume. A single range is packed into masks
+    // of 64 voxels per word instead.
+    typedef uint64_t RangeMask;
+    constexpr size_t MaxScanRanges = 64;
+
+    template <typename PixelType>
+    class RangeClassifier {
+    private:
+        const ValueRanges<PixelType>& ranges;
+        std::vector<RangeMask> table;    // Mask of every value, for small integer types
+
+    public:
+        explicit RangeClassifier(const ValueRanges<PixelType>& ranges) : ranges(ranges) {
+            // With many labels, one lookup per voxel beats testing every range
+            if (ranges.size() > 2 && std::is_integral<PixelType>::value && sizeof(PixelType) <= 2) {
+                const long lowest = static_cast<long>(std::numeric_limits<PixelType>::min());
+                const long highest = static_cast<long>(std::numeric_limits<PixelType>::max());
+                table.assign(static_cast<size_t>(highest - lowest + 1), 0);
+                for (size_t r = 0; r < ranges.size(); ++r) {
+                    for (long value = ranges[r].first; value <= static_cast<long>(ranges[r].second); ++value) {
+                        table[static_cast<size_t>(value - lowest)] |= RangeMask(1) << r;
+                    }
+                }
+            }
+        }
+
+        const ValueRanges<PixelType>& getRanges() const {
+            return ranges;
+        }
+
+        void classify(const PixelType* values, size_t count, RangeMask* target) const {
+            if (!table.empty()) {
+                const long lowest = static_cast<long>(std::numeric_limits<PixelType>::min());
+                for (size_t i = 0; i < count; ++i) {
+                    target[i] = table[static_cast<size_t>(static_cast<long>(values[i]) - lowest)];
+                }
+            } else {
+                for (size_t i = 0; i < count; ++i) {
+                    RangeMask mask = 0;
+                    for (size_t r = 0; r < ranges.size(); ++r) {
+                        if (values[i] >= ranges[r].first && values[i] <= ranges[r].second) {
+                            mask |= RangeMask(1) << r;
+                        }
+                    }
+                    target[i] = mask;
+                }
+            }
+        }
+    };
+
+    unsigned int countBits(RangeMask mask) {
+        unsigned int count = 0;
+        for (; mask != 0; mask &= mask - 1) {
+            ++count;
+        }
+        return count;
+    }
+
+    unsigned int lowestBit(RangeMask mask) {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<unsigned int>(__builtin_ctzll(mask));
+#else
+        unsigned int bit = 0;
+        while ((mask & 1) == 0) {
+            mask >>= 1;
+            ++bit;
+        }
+        return bit;
+#endif
+    }
+
+    // Vertex indices of the edges of two planes of points: the edges along X
+    // and Y in the bottom and top planes, and the vertical edges in between
+    struct EdgeCache {
+        std::vector<uint32_t> bottom[2];
+        std::vector<uint32_t> top[2];
+        std::vector<uint32_t> vertical;
+
+        explicit EdgeCache(size_t planeSize) :
+                bottom{std::vector<uint32_t>(planeSize, NoVertex), std::vector<uint32_t>(planeSize, NoVertex)},
+                top{std::vector<uint32_t>(planeSize), std::vector<uint32_t>(planeSize)},
+                vertical(planeSize) {}
+
+        void startLayer() {
+            std::fill(top[0].begin(), top[0].end(), NoVertex);
+            std::fill(top[1].begin(), top[1].end(), NoVertex);
+            std::fill(vertical.begin(), vertical.end(), NoVertex);
+        }
+
+        void finishLayer() {
+            bottom[0].swap(top[0]);
+            bottom[1].swap(top[1]);
+        }
+    };
+
+    // Ranges that may cross each brick of cells of a slab, a brick of cells
+    // having the size of a brick of voxels: brick b along an axis holds the
+    // cells [BrickSize * b, BrickSize * (b + 1)).
+    struct ActiveBricks {
+        size_t brickSize;
+        size_t countX;
+        size_t countY;
+        size_t firstLayer;
+        std::vector<RangeMask> masks;
+        std::vector<uint8_t> rows;    // Whether a row of bricks has any brick left
+
+        size_t getRowIndex(size_t j, size_t k) const {
+            return j / brickSize + countY * (k / brickSize - firstLayer);
+        }
+
+        bool isRowActive(size_t j, size_t k) const {
+            return rows[getRowIndex(j, k)] != 0;
+        }
+
+        // Bricks of the row of cells j in the layer k
+        const RangeMask* getRow(size_t j, size_t k) const {
+            return &masks[countX * getRowIndex(j, k)];
+        }
+    };
+
+    // The grid is padded with one background voxel on each side: padded
+    // point (i, j, k) is voxel (i - 1, j - 1, k - 1). The voxels may only
+    // hold the slices from "firstSlice" on.
+    template <typename PixelType>
+    class SlabExtractor {
+    private:
+        const PixelType* voxels;
+        size_t firstSlice;
+        const VolumeGeometry& geometry;
+        const RangeClassifier<PixelType>& classifier;
+        const BrickGrid<PixelType>* bricks;
+        size_t px;
+        size_t py;
+        size_t pz;
+        size_t rowWords;
+        double transform[3][3];
+        bool flip;
+
+        const PixelType* getRow(size_t j, size_t k) const {
+            return voxels + geometry.size[0] * ((j - 1) + geometry.size[1] * (k - 1 - firstSlice));
+        }
+
+        // Voxel bricks under the cells of brick b along an axis of n voxels,
+        // whose points are the voxels [BrickSize * b - 1, BrickSize * (b + 1) - 1]
+        static void getVoxelBricks(size_t b, size_t n, size_t& first, size_t& last, bool& border) {
+            const size_t size = BrickGrid<PixelType>::BrickSize;
+            first = (b == 0 ? 0 : size * b - 1) / size;
+            last = std::min(n - 1, size * (b + 1) - 1) / size;
+            border = (b == 0 || size * (b + 1) > n);
+        }
+
+        // A range may cross a brick of cells unless its voxels all lie
+        // outside of the range, or all inside of it away from the padding
+        ActiveBricks findActiveBricks(size_t k0, size_t k1) const {
+            const size_t size = BrickGrid<PixelType>::BrickSize;
+            const ValueRanges<PixelType>& ranges = classifier.getRanges();
+
+            ActiveBricks active;
+            active.brickSize = size;
+            active.countX = (px - 1 + size - 1) / size;
+            active.countY = (py - 1 + size - 1) / size;
+            active.firstLayer = k0 / size;
+
+            const size_t layers = (k1 - 1) / size - active.firstLayer + 1;
+            const RangeMask all = (ranges.size() == MaxScanRanges ? ~RangeMask(0) :
+                                   (RangeMask(1) << ranges.size()) - 1);
+            active.masks.assign(active.countX * active.countY * layers, all);
+            active.rows.assign(active.countY * layers, 1);
+            if (bricks == nullptr) {
+                return active;
+            }
+
+            for (size_t l = 0; l < layers; ++l) {
+                size_t firstK, lastK;
+                bool borderK;
+                getVoxelBricks(active.firstLayer + l, geometry.size[2], firstK, lastK, borderK);
+
+                for (size_t bj = 0; bj < active.countY; ++bj) {
+                    size_t firstJ, lastJ;
+                    bool borderJ;
+                    getVoxelBricks(bj, geometry.size[1], firstJ, lastJ, borderJ);
+
+                    uint8_t& row = active.rows[bj + active.countY * l];
+                    row = 0;
+
+                    for (size_t bi = 0; bi < active.countX; ++bi) {
+                        size_t firstI, lastI;
+                        bool borderI;
+                        getVoxelBricks(bi, geometry.size[0], firstI, lastI, borderI);
+
+                        PixelType minimum = bricks->getMinimum(firstI, firstJ, firstK);
+                        PixelType maximum = bricks->getMaximum(firstI, firstJ, firstK);
+                        for (size_t k = firstK; k <= lastK; ++k) {
+                            for (size_t j = firstJ; j <= lastJ; ++j) {
+                                for (size_t i = firstI; i <= lastI; ++i) {
+                                    minimum = std::min(minimum, bricks->getMinimum(i, j, k));
+                                    maximum = std::max(maximum, bricks->getMaximum(i, j, k));
+                                }
+                            }
+                        }
+
+                        const bool border = (borderI || borderJ || borderK);
+                        RangeMask mask = 0;
+                        for (size_t r = 0; r < ranges.size(); ++r) {
+                            const bool outside = (maximum < ranges[r].first || minimum > ranges[r].second);
+                            const bool inside = (minimum >= ranges[r].first && maximum <= ranges[r].second);
+                            if (!outside && (!inside || border)) {
+                                mask |= RangeMask(1) << r;
+                            }
+                        }
+
+                        active.masks[bi + active.countX * (bj + active.countY * l)] = mask;
+                        row |= (mask != 0 ? 1 : 0);
+                    }
+                }
+            }
+
+            return active;
+        }
+
+        // Whether the cells of the layers [k0, k1) left by the bricks read the
+        // row j of points of the plane k
+        bool isPointRowUsed(const ActiveBricks& active, size_t j, size_t k, size_t k0, size_t k1) const {
+            for (size_t layer = (k > k0 ? k - 1 : k); layer <= k && layer < k1; ++layer) {
+                if ((j > 0 && active.isRowActive(j - 1, layer)) ||
+                    (j + 1 < py && active.isRowActive(j, layer))) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void classifyPlane(size_t k, std::vector<RangeMask>& plane,
+                           const ActiveBricks& active, size_t k0, size_t k1) const {
+            std::fill(plane.begin(), plane.end(), 0);
+            if (k == 0 || k == pz - 1) {
+                return;
+            }
+
+            for (size_t j = 1; j < py - 1; ++j) {
+                if (isPointRowUsed(active, j, k, k0, k1)) {
+                    classifier.classify(getRow(j, k), geometry.size[0], &plane[px * j + 1]);
+                }
+            }
+        }
+
+        // Packs the plane of a single range, one row of points after the
+        // other, shifting the voxels by the padding
+        void packPlane(size_t k, std::vector<uint64_t>& plane, std::vector<uint64_t>& row,
+                       const ActiveBricks& active, size_t k0, size_t k1) const {
+            std::fill(plane.begin(), plane.end(), 0);
+            if (k == 0 || k == pz - 1) {
+                return;
+            }
+
+            const ValueRanges<PixelType>& ranges = classifier.getRanges();
+            const size_t voxelWords = getMaskWords(geometry.size[0]);
+            for (size_t j = 1; j < py - 1; ++j) {
+                if (!isPointRowUsed(active, j, k, k0, k1)) {
+                    continue;
+                }
+
+                packRangeMask(getRow(j, k), geometry.size[0], ranges[0].first, ranges[0].second, row.data());
+
+                uint64_t* target = &plane[rowWords * j];
+                uint64_t carry = 0;
+                for (size_t w = 0; w < voxelWords; ++w) {
+                    target[w] = (row[w] << 1) | carry;
+                    carry = row[w] >> (MaskWordBits - 1);
+                }
+                if (voxelWords < rowWords) {
+                    target[voxelWords] = carry;
+                }
+            }
+        }
+
+        uint32_t addPoint(Slab& slab, double i, double j, double k) const {
+            const double grid[3] = {i - 1, j - 1, k - 1};
+            for (unsigned int r = 0; r < 3; ++r) {
+                slab.points.push_back(static_cast<float>(geometry.origin[r] +
+                                                         transform[r][0] * grid[0] +
+                                                         transform[r][1] * grid[1] +
+                                                         transform[r][2] * grid[2]));
+            }
+            return static_cast<uint32_t>(slab.points.size() / 3 - 1);
+        }
+
+        // Adds the triangles of a cell. "slot" gives the vertex of an edge of
+        // the cell from its entry in the edge cache.
+        template <typename Slot>
+        void addCell(Slab& slab, unsigned int cube, size_t i, size_t j, size_t k, size_t k0, size_t k1,
+                     EdgeCache& edges, const Slot& slot) const {
+            const CaseTable& table = getCaseTable();
+
+            for (unsigned int t = 0; t < table.triangleCount[cube]; ++t) {
+                uint32_t triangle[3];
+
+                for (unsigned int v = 0; v < 3; ++v) {
+                    const CubeEdge& edge = cubeEdges[table.edges[cube][3 * t + v]];
+                    const size_t dx = edge.corner & 1;
+                    const size_t dy = (edge.corner >> 1) & 1;
+                    const size_t dz = (edge.corner >> 2) & 1;
+                    const size_t q = (i + dx) + px * (j + dy);
+
+                    uint32_t& cached = slot(edge, edge.axis == 2 ? edges.vertical[q] :
+                                                  (dz == 0 ? edges.bottom[edge.axis][q] : edges.top[edge.axis][q]));
+
+                    if (cached == NoVertex) {
+                        cached = addPoint(slab,
+                                          i + dx + (edge.axis == 0 ? 0.5 : 0.0),
+                                          j + dy + (edge.axis == 1 ? 0.5 : 0.0),
+                                          k + dz + (edge.axis == 2 ? 0.5 : 0.0));
+
+                        if (edge.axis != 2) {
+                            const uint32_t key = static_cast<uint32_t>(2 * q + edge.axis);
+                            if (k + dz == k0) {
+                                slab.bottom.push_back(std::make_pair(key, cached));
+                            } else if (k + dz == k1) {
+                                slab.top.push_back(std::make_pair(key, cached));
+                            }
+                        }
+                    }
+
+                    triangle[v] = cached;
+                }
+
+                slab.triangles.push_back(triangle[0]);
+                slab.triangles.push_back(flip ? triangle[2] : triangle[1]);
+                slab.triangles.push_back(flip ? triangle[1] : triangle[2]);
+            }
+        }
+
+        // A single range works on packed planes: a few word operations find
+        // which of 64 cells of a row the surface crosses, so the empty and
+        // full parts of the volume cost little. The edge caches hold the
+        // vertex indices right away.
+        void extractPacked(size_t k0, size_t k1, Slab& slab) const {
+            static_assert(MaskWordBits % BrickGrid<PixelType>::BrickSize == 0, "Bricks must not straddle words");
+            const size_t brickSize = BrickGrid<PixelType>::BrickSize;
+            const size_t wordBricks = MaskWordBits / brickSize;
+            const ActiveBricks active = findActiveBricks(k0, k1);
+            const size_t planeWords = rowWords * py;
+
+            std::vector<uint64_t> below(planeWords);
+            std::vector<uint64_t> above(planeWords);
+            std::vector<uint64_t> row(getMaskWords(geometry.size[0]));
+            EdgeCache edges(px * py);
+
+            const auto direct = [](const CubeEdge&, uint32_t& cached) -> uint32_t& {
+                return cached;
+            };
+
+            packPlane(k0, below, row, active, k0, k1);
+            for (size_t k = k0; k < k1; ++k) {
+                packPlane(k + 1, above, row, active, k0, k1);
+                edges.startLayer();
+
+                for (size_t j = 0; j + 1 < py; ++j) {
+                    if (!active.isRowActive(j, k)) {
+                        continue;
+                    }
+
+                    const RangeMask* brickMasks = active.getRow(j, k);
+                    const uint64_t* rows[4] = {&below[rowWords * j], &below[rowWords * (j + 1)],
+                                               &above[rowWords * j], &above[rowWords * (j + 1)]};
+
+                    for (size_t w = 0; w < rowWords; ++w) {
+                        uint64_t activeCells = 0;
+                        for (size_t b = 0; b < wordBricks && w * wordBricks + b < active.countX; ++b) {
+                            if (brickMasks[w * wordBricks + b] != 0) {
+                                activeCells |= ((uint64_t(1) << brickSize) - 1) << (b * brickSize);
+                            }
+                        }
+                        if (activeCells == 0) {
+                            continue;
+                        }
+
+                        const bool last = (w + 1 == rowWords);
+                        uint64_t any = 0;
+                        uint64_t all = ~uint64_t(0);
+                        uint64_t nextAny = 0;
+                        uint64_t nextAll = (last ? 0 : ~uint64_t(0));
+                        for (const uint64_t* points : rows) {
+                            any |= points[w];
+                            all &= points[w];
+                            if (!last) {
+                                nextAny |= points[w + 1];
+                                nextAll &= points[w + 1];
+                            }
+                        }
+
+                        // Cell i spans the points i and i + 1 of the rows
+                        const uint64_t anyCell = any | (any >> 1) | (nextAny << (MaskWordBits - 1));
+                        const uint64_t allCell = all & ((all >> 1) | (nextAll << (MaskWordBits - 1)));
+
+                        for (uint64_t crossed = anyCell & ~allCell & activeCells; crossed != 0; crossed &= crossed - 1) {
+                            const size_t i = w * MaskWordBits + lowestBit(crossed);
+                            unsigned int cube = 0;
+                            for (unsigned int r = 0; r < 4; ++r) {
+                                cube |= static_cast<unsigned int>(getMaskBit(rows[r], i) |
+                                                                  (getMaskBit(rows[r], i + 1) << 1)) << (2 * r);
+                            }
+
+                            addCell(slab, cube, i, j, k, k0, k1, edges, direct);
+                        }
+                    }
+                }
+
+                below.swap(above);
+                edges.finishLayer();
+            }
+        }
+
+        // Several ranges classify each point into a mask of the ranges it
+        // lies in. An edge crossed by several surfaces gets a block of vertex
+        // slots, one per crossing range in bit order.
+        void extractRanges(size_t k0, size_t k1, Slab* slabs) const {
+            const size_t brickSize = BrickGrid<PixelType>::BrickSize;
+            const ActiveBricks active = findActiveBricks(k0, k1);
+            const size_t planeSize = px * py;
+
+            std::vector<RangeMask> below(planeSize);
+            std::vector<RangeMask> above(planeSize);
+            EdgeCache edges(planeSize);
+            std::vector<uint32_t> slots;
+
+            classifyPlane(k0, below, active, k0, k1);
+            for (size_t k = k0; k < k1; ++k) {
+                classifyPlane(k + 1, above, active, k0, k1);
+                edges.startLayer();
+
+                for (size_t j = 0; j + 1 < py; ++j) {
+                    if (!active.isRowActive(j, k)) {
+                        continue;
+                    }
+
+                    const RangeMask* brickMasks = active.getRow(j, k);
+                    for (size_t i = 0; i + 1 < px; ++i) {
+                        const RangeMask brickMask = brickMasks[i / brickSize];
+                        if (brickMask == 0) {
+                            i += brickSize - 1 - i % brickSize;
+                            continue;
+                        }
+
+                        const size_t p = i + px * j;
+                        const RangeMask corners[8] = {below[p], below[p + 1], below[p + px], below[p + px + 1],
+                                                      above[p], above[p + 1], above[p + px], above[p + px + 1]};
+
+                        RangeMask any = 0;
+                        RangeMask all = ~RangeMask(0);
+                        for (RangeMask corner : corners) {
+                            any |= corner;
+                            all &= corner;
+                        }
+
+                        for (RangeMask crossed = any & ~all & brickMask; crossed != 0; crossed &= crossed - 1) {
+                            const unsigned int range = lowestBit(crossed);
+
+                            unsigned int cube = 0;
+                            for (unsigned int c = 0; c < 8; ++c) {
+                                cube |= static_cast<unsigned int>((corners[c] >> range) & 1) << c;
+                            }
+
+                            addCell(slabs[range], cube, i, j, k, k0, k1, edges,
+                                    [&](const CubeEdge& edge, uint32_t& base) -> uint32_t& {
+                                const RangeMask edgeRanges = corners[edge.corner] ^ corners[edge.corner | (1u << edge.axis)];
+                                if (base == NoVertex) {
+                                    base = static_cast<uint32_t>(slots.size());
+                                    slots.resize(slots.size() + countBits(edgeRanges), NoVertex);
+                                }
+
+                                const RangeMask lowerRanges = edgeRanges & ((RangeMask(1) << range) - 1);
+                                return slots[base + countBits(lowerRanges)];
+                            });
+                        }
+                    }
+                }
+
+                below.swap(above);
+                edges.finishLayer();
+            }
+        }
+
+    public:
+        // The brick grid, if any, must cover the whole volume
+        SlabExtractor(const PixelType* voxels, size_t firstSlice, const VolumeGeometry& geometry,
+                      const RangeClassifier<PixelType>& classifier, const BrickGrid<PixelType>* bricks) :
+                voxels(voxels), firstSlice(firstSlice), geometry(geometry), classifier(classifier), bricks(bricks),
+                px(geometry.size[0] + 2), py(geometry.size[1] + 2), pz(geometry.size[2] + 2),
+                rowWords(getMaskWords(geometry.size[0] + 2)) {
+            for (unsigned int r = 0; r < 3; ++r) {
+                for (unsigned int c = 0; c < 3; ++c) {
+                    transform[r][c] = geometry.direction[3 * r + c] * geometry.spacing[c];
+                }
+            }
+
+            const double* d = geometry.direction;
+            const double determinant = d[0] * (d[4] * d[8] - d[5] * d[7]) -
+                                       d[1] * (d[3] * d[8] - d[5] * d[6]) +
+                                       d[2] * (d[3] * d[7] - d[4] * d[6]);
+            flip = (determinant < 0);
+        }
+
+        size_t getLayerCount() const {
+            return pz - 1;
+        }
+
+        // Meshes the cells whose lowest corner lies in the layers [k0, k1),
+        // into one slab per range
+        void extract(size_t k0, size_t k1, Slab* slabs, size_t rangeCount) const {
+            if (rangeCount == 1) {
+                extractPacked(k0, k1, slabs[0]);
+            } else {
+                extractRanges(k0, k1, slabs);
+            }
+
+            for (size_t r = 0; r < rangeCount; ++r) {
+                std::sort(slabs[r].bottom.begin(), slabs[r].bottom.end());
+                std::sort(slabs[r].top.begin(), slabs[r].top.end());
+            }
+        }
+    };
+
+    // Appends the slabs in order, welding the vertices that the bottom plane
+    // of each slab shares with the top plane of the previous one. The slabs
+    // of one range lie "stride" apart.
+    void mergeSlabs(Slab* slabs, size_t count, size_t stride, TriangleMesh& target) {
+        size_t pointCount = 0;
+        size_t triangleCount = 0;
+        for (size_t s = 0; s < count; ++s) {
+            pointCount += slabs[s * stride].points.size();
+            triangleCount += slabs[s * stride].triangles.size();
+        }
+
+        target.clear();
+        target.points.reserve(pointCount);
+        target.triangles.reserve(triangleCount);
+
+        Seam previousTop;    // Edge key, global vertex index
+        for (size_t s = 0; s < count; ++s) {
+            Slab& slab = slabs[s * stride];
+            std::vector<uint32_t> remap(slab.points.size() / 3, NoVertex);
+
+            Seam::const_iterator shared = previousTop.begin();
+            for (const std::pair<uint32_t, uint32_t>& entry : slab.bottom) {
+                while (shared != previousTop.end() && shared->first < entry.first) {
+                    ++shared;
+                }
+                if (shared != previousTop.end() && shared->first == entry.first) {
+                    remap[entry.second] = shared->second;
+                }
+            }
+
+            for (size_t v = 0; v < remap.size(); ++v) {
+                if (remap[v] == NoVertex) {
+                    remap[v] = static_cast<uint32_t>(target.points.size() / 3);
+                    target.points.insert(target.points.end(), slab.points.begin() + 3 * v, slab.points.begin() + 3 * v + 3);
+                }
+            }
+
+            for (uint32_t index : slab.triangles) {
+                target.triangles.push_back(remap[index]);
+            }
+
+            previousTop.clear();
+            for (const std::pair<uint32_t, uint32_t>& entry : slab.top) {
+                previousTop.push_back(std::make_pair(entry.first, remap[entry.second]));
+            }
+
+            slab = Slab();
+        }
+
+        // The reservation counted the welded seam vertices twice
+        target.shrinkToFit();
+    }
+
+    // Runs task(0) to task(count - 1) on up to "threads" threads, 0 meaning
+    // one per core, and rethrows the first exception of a task
+    template <typename Task>
+    void parallelFor(size_t count, unsigned int threads, const Task& task) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        threads = static_cast<unsigned int>(std::min<size_t>(threads, count));
+
+        std::atomic<size_t> next(0);
+        std::exception_ptr failure;
+        std::mutex failureMutex;
+
+        auto worker = [&]() {
+            try {
+                for (size_t i = next++; i < count; i = next++) {
+                    task(i);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(failureMutex);
+                failure = std::current_exception();
+                next = count;
+            }
+        };
+
+        if (threads <= 1) {
+            worker();
+        } else {
+            std::vector<std::thread> pool;
+            for (unsigned int t = 0; t < threads; ++t) {
+                pool.emplace_back(worker);
+            }
+            for (std::thread& thread : pool) {
+                thread.join();
+            }
+        }
+
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    // Meshes the ranges by groups of at most 64, each group in one scan of
+    // the volume. "extract" meshes one slab for a group of ranges.
+    template <typename PixelType, typename Extract>
+    void extractGroups(const VolumeGeometry& geometry,
+                       const ValueRanges<PixelType>& ranges,
+                       unsigned int threads,
+                       std::vector<TriangleMesh>& targets,
+                       const Extract& extract) {
+        const size_t layers = geometry.size[2] + 1;
+        const size_t slabCount = (layers + SlabLayers - 1) / SlabLayers;
+
+        targets.clear();
+        targets.resize(ranges.size());
+
+        for (size_t group = 0; group < ranges.size(); group += MaxScanRanges) {
+            const ValueRanges<PixelType> scanned(ranges.begin() + group,
+                                                 ranges.begin() + std::min(ranges.size(), group + MaxScanRanges));
+            const RangeClassifier<PixelType> classifier(scanned);
+            const size_t rangeCount = scanned.size();
+
+            std::vector<Slab> slabs(slabCount * rangeCount);
+            parallelFor(slabCount, threads, [&](size_t s) {
+                extract(classifier, s * SlabLayers, std::min(layers, (s + 1) * SlabLayers), &slabs[s * rangeCount], rangeCount);
+            });
+
+            // One mesh per range, merged in parallel
+            parallelFor(rangeCount, threads, [&](size_t r) {
+                mergeSlabs(&slabs[r], slabCount, rangeCount, targets[group + r]);
+            });
+        }
+    }
+
+    // Meshes the cells of the layers [k0, k1) of a volume that is loaded
+    // slab by slab, loading the slices that they read first
+    template <typename PixelType>
+    void extractLoadedSlab(const SliceLoader<PixelType>& loader, const VolumeGeometry& geometry,
+                           const RangeClassifier<PixelType>& classifier, size_t k0, size_t k1,
+                           Slab* slabs, size_t rangeCount) {
+        // The cells of layers [k0, k1) read the padded planes k0 to k1, that
+        // is the voxel slices k0 - 1 to k1 - 1 that are in the volume.
+        // Consecutive slabs overlap by one slice.
+        const size_t first = (k0 == 0 ? 0 : k0 - 1);
+        const size_t last = std::min(k1, geometry.size[2]);
+
+        std::vector<PixelType> window((last - first) * geometry.size[0] * geometry.size[1]);
+        if (first < last) {
+            loader(window.data(), first, last);
+        }
+
+        const SlabExtractor<PixelType> extractor(window.data(), first, geometry, classifier, nullptr);
+        extractor.extract(k0, k1, slabs, rangeCount);
+    }
+
+    // Meshes the slabs of a single range on up to "threads" threads, and
+    // hands them over to the callback on the calling thread, in slab order.
+    // "extract" meshes the cells of the layers [k0, k1) into a slab.
+    template <typename Extract>
+    void streamSlabs(size_t layers, unsigned int threads, const SlabCallback& callback, const Extract& extract) {
+        const size_t slabCount = (layers + SlabLayers - 1) / SlabLayers;
+        std::vector<Slab> slabs(slabCount);
+        std::vector<bool> ready(slabCount, false);
+
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        threads = static_cast<unsigned int>(std::min<size_t>(threads, slabCount));
+
+        std::atomic<size_t> nextSlab(0);
+        std::exception_ptr failure;
+        std::mutex mutex;
+        std::condition_variable finished;
+
+        auto worker = [&]() {
+            try {
+                for (size_t s = nextSlab++; s < slabCount; s = nextSlab++) {
+                    extract(s * SlabLayers, std::min(layers, (s + 1) * SlabLayers), slabs[s]);
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ready[s] = true;
+                    finished.notify_all();
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                failure = std::current_exception();
+                nextSlab = slabCount;
+                finished.notify_all();
+            }
+        };
+
+        // Without worker threads, the calling thread meshes each slab right
+        // before handing it over
+        std::vector<std::thread> pool;
+        if (threads > 1) {
+            for (unsigned int t = 0; t < threads; ++t) {
+                pool.emplace_back(worker);
+            }
+        }
+
+        try {
+            for (size_t s = 0; s < slabCount; ++s) {
+                if (pool.empty()) {
+                    extract(s * SlabLayers, std::min(layers, (s + 1) * SlabLayers), slabs[s]);
+                } else {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    finished.wait(lock, [&]() { return ready[s] || failure; });
+                    if (failure) {
+                        break;
+                    }
+                }
+
+                TriangleMesh mesh;
+                mesh.points.swap(slabs[s].points);
+                mesh.triangles.swap(slabs[s].triangles);
+                slabs[s] = Slab();
+
+                if (!mesh.triangles.empty()) {
+                    callback(mesh);
+                }
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!failure) {
+                failure = std::current_exception();
+            }
+            nextSlab = slabCount;
+        }
+
+        for (std::thread& thread : pool) {
+            thread.join();
+        }
+
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+}
+
+template <typename PixelType>
+void extractIsosurfaces(const PixelType* voxels,
+                        const VolumeGeometry& geometry,
+                        const ValueRanges<PixelType>& ranges,
+                        unsigned int threads,
+                        std::vector<TriangleMesh>& targets,
+                        const BrickGrid<PixelType>* bricks) {
+    extractGroups<PixelType>(geometry, ranges, threads, targets,
+                             [&](const RangeClassifier<PixelType>& classifier, size_t k0, size_t k1,
+                                 Slab* slabs, size_t rangeCount) {
+        const SlabExtractor<PixelType> extractor(voxels, 0, geometry, classifier, bricks);
+        extractor.extract(k0, k1, slabs, rangeCount);
+    });
+}
+
+template <typename PixelType>
+void extractIsosurface(const PixelType* voxels,
+                       const VolumeGeometry& geometry,
+                       PixelType lower,
+                       PixelType upper,
+                       unsigned int threads,
+                       TriangleMesh& target,
+                       const BrickGrid<PixelType>* bricks) {
+    std::vector<TriangleMesh> targets;
+    extractIsosurfaces(voxels, geometry, ValueRanges<PixelType>(1, std::make_pair(lower, upper)), threads, targets,
+                       bricks);
+    target.points.swap(targets[0].points);
+    target.triangles.swap(targets[0].triangles);
+    target.normals.clear();
+}
+
+template <typename PixelType>
+void extractIsosurfaceSlabs(const PixelType* voxels,
+                            const VolumeGeometry& geometry,
+                            PixelType lower,
+                            PixelType upper,
+                            unsigned int threads,
+                            const SlabCallback& callback,
+                            const BrickGrid<PixelType>* bricks) {
+    const ValueRanges<PixelType> ranges(1, std::make_pair(lower, upper));
+    const RangeClassifier<PixelType> classifier(ranges);
+    const SlabExtractor<PixelType> extractor(voxels, 0, geometry, classifier, bricks);
+
+    streamSlabs(extractor.getLayerCount(), threads, callback, [&](size_t k0, size_t k1, Slab& slab) {
+        extractor.extract(k0, k1, &slab, 1);
+    });
+}
+
+template <typename PixelType>
+void extractIsosurfacesOutOfCore(const SliceLoader<PixelType>& loader,
+                                 const VolumeGeometry& geometry,
+                                 const ValueRanges<PixelType>& ranges,
+                                 unsigned int threads,
+                                 std::vector<TriangleMesh>& targets) {
+    extractGroups<PixelType>(geometry, ranges, threads, targets,
+                             [&](const RangeClassifier<PixelType>& classifier, size_t k0, size_t k1,
+                                 Slab* slabs, size_t rangeCount) {
+        extractLoadedSlab<PixelType>(loader, geometry, classifier, k0, k1, slabs, rangeCount);
+    });
+}
+
+template <typename PixelType>
+void extractIsosurfaceSlabsOutOfCore(const SliceLoader<PixelType>& loader,
+                                     const VolumeGeometry& geometry,
+                                     PixelType lower,
+                                     PixelType upper,
+                                     unsigned int threads,
+                                     const SlabCallback& callback) {
+    const ValueRanges<PixelType> ranges(1, std::make_pair(lower, upper));
+    const RangeClassifier<PixelType> classifier(ranges);
+
+    streamSlabs(geometry.size[2] + 1, threads, callback, [&](size_t k0, size_t k1, Slab& slab) {
+        extractLoadedSlab<PixelType>(loader, geometry, classifier, k0, k1, &slab, 1);
+    });
+}
+
+template void extractIsosurfaces<uint8_t>(const uint8_t*, const VolumeGeometry&,
+                                          const ValueRanges<uint8_t>&, unsigned int,
+                                          std::vector<TriangleMesh>&, const BrickGrid<uint8_t>*);
+
+template void extractIsosurface<uint8_t>(const uint8_t*, const VolumeGeometry&,
+                                         uint8_t, uint8_t, unsigned int, TriangleMesh&,
+                                         const BrickGrid<uint8_t>*);
+
+template void extractIsosurfaceSlabs<uint8_t>(const uint8_t*, const VolumeGeometry&,
+                                              uint8_t, uint8_t, unsigned int,
+                                              const SlabCallback&, const BrickGrid<uint8_t>*);
+
+template void extractIsosurfacesOutOfCore<uint8_t>(const SliceLoader<uint8_t>&, const VolumeGeometry&,
+                                                   const ValueRanges<uint8_t>&, unsigned int,
+                                                   std::vector<TriangleMesh>&);
+
+template void extractIsosurfaceSlabsOutOfCore<uint8_t>(const SliceLoader<uint8_t>&, const VolumeGeometry&,
+                                                       uint8_t, uint8_t, unsigned int,
+                                                       const SlabCallback&);
+
+template void extractIsosurfaces<int16_t>(const int16_t*, const VolumeGeometry&,
+                                          const ValueRanges<int16_t>&, unsigned int,
+                                          std::vector<TriangleMesh>&, const BrickGrid<int16_t>*);
+
+template void extractIsosurface<int16_t>(const int16_t*, const VolumeGeometry&,
+                                         int16_t, int16_t, unsigned int, TriangleMesh&,
+                                         const BrickGrid<int16_t>*);
+
+template void extractIsosurfaceSlabs<int16_t>(const int16_t*, const VolumeGeometry&,
+                                              int16_t, int16_t, unsigned int,
+                                              const SlabCallback&, const BrickGrid<int16_t>*);
+
+template void extractIsosurfacesOutOfCore<int16_t>(const SliceLoader<int16_t>&, const VolumeGeometry&,
+                                                   const ValueRanges<int16_t>&, unsigned int,
+                                                   std::vector<TriangleMesh>&);
+
+template void extractIsosurfaceSlabsOutOfCore<int16_t>(const SliceLoader<int16_t>&, const VolumeGeometry&,
+                                                       int16_t, int16_t, unsigned int,
+                                                       const SlabCallback&);
+
+template void extractIsosurfaces<unsigned short>(const unsigned short*, const VolumeGeometry&,
+                                                 const ValueRanges<unsigned short>&, unsigned int,
+                                                 std::vector<TriangleMesh>&, const BrickGrid<unsigned short>*);
+
+template void extractIsosurface<unsigned short>(const unsigned short*, const VolumeGeometry&,
+                                                unsigned short, unsigned short, unsigned int, TriangleMesh&,
+                                                const BrickGrid<unsigned short>*);
+
+template void extractIsosurfaceSlabs<unsigned short>(const unsigned short*, const VolumeGeometry&,
+                                                     unsigned short, unsigned short, unsigned int,
+                                                     const SlabCallback&, const BrickGrid<unsigned short>*);
+
+template void extractIsosurfacesOutOfCore<unsigned short>(const SliceLoader<unsigned short>&, const VolumeGeometry&,
+                                                          const ValueRanges<unsigned short>&, unsigned int,
+                                                          std::vector<TriangleMesh>&);
+
+template void extractIsosurfaceSlabsOutOfCore<unsigned short>(const SliceLoader<unsigned short>&, const VolumeGeometry&,
+                                                              unsigned short, unsigned short, unsigned int,
+                                                              const SlabCallback&);
+
+template void extractIsosurfaces<float>(const float*, const VolumeGeometry&,
+                                        const ValueRanges<float>&, unsigned int,
+                                        std::vector<TriangleMesh>&, const BrickGrid<float>*);
+
+template void extractIsosurface<float>(const float*, const VolumeGeometry&,
+                                       float, float, unsigned int, TriangleMesh&,
+                                       const BrickGrid<float>*);
+
+template void extractIsosurfaceSlabs<float>(const float*, const VolumeGeometry&,
+                                            float, float, unsigned int,
+                                            const SlabCallback&, const BrickGrid<float>*);
+
+template void extractIsosurfacesOutOfCore<float>(const SliceLoader<float>&, const VolumeGeometry&,
+                                                 const ValueRanges<float>&, unsigned int,
+                                                 std::vector<TriangleMesh>&);
+
+template void extractIsosurfaceSlabsOutOfCore<float>(const SliceLoader<float>&, const VolumeGeometry&,
+                                                     float, float, unsigned int,
+                                                     const SlabCallback&);
@@ -0,0 +1,96 @@
+#ifndef DICOMITKLIBRARY_MARCHINGCUBES_H
+#define DICOMITKLIBRARY_MARCHINGCUBES_H
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "BrickGrid.h"
+#include "TriangleMesh.h"
+
+// Size and placement of a voxel grid in patient coordinates. The direction
+// matrix is row-major, its columns being the directions of the grid axes.
+struct VolumeGeometry {
+    size_t size[3];
+    double spacing[3];
+    double origin[3];
+    double direction[9];
+};
+
+// Inclusive ranges of voxel values, as (lower, upper) pairs
+template <typename PixelType>
+using ValueRanges = std::vector<std::pair<PixelType, PixelType> >;
+
+// Extracts the boundary of the voxels whose value lies in [lower, upper] with
+// marching cubes. The volume is cut into Z-slabs of a fixed thickness that
+// are meshed on up to "threads" threads (0 meaning one per core), then merged
+// in slab order, so the output does not depend on the number of threads.
+// Voxels outside of the volume count as background, so surfaces are closed.
+// Given the brick grid of the volume, the bricks that the range does not
+// cross are skipped without reading their voxels.
+template <typename PixelType>
+void extractIsosurface(const PixelType* voxels,
+                       const VolumeGeometry& geometry,
+                       PixelType lower,
+                       PixelType upper,
+                       unsigned int threads,
+                       TriangleMesh& target,
+                       const BrickGrid<PixelType>* bricks = nullptr);
+
+// Same as above for several ranges at once, such as the labels of a
+// segmentation, producing one mesh per range in the order of the ranges.
+// Every slab is scanned once for up to 64 ranges, and the meshes of the
+// ranges are merged in parallel.
+template <typename PixelType>
+void extractIsosurfaces(const PixelType* voxels,
+                        const VolumeGeometry& geometry,
+                        const ValueRanges<PixelType>& ranges,
+                        unsigned int threads,
+                        std::vector<TriangleMesh>& targets,
+                        const BrickGrid<PixelType>* bricks = nullptr);
+
+typedef std::function<void(TriangleMesh& slab)> SlabCallback;
+
+// Same as above, handing the surface over slab by slab instead of merging
+// it: the vertices on the boundary between two slabs are repeated in both.
+// The callback runs on the calling thread, in slab order, as soon as the
+// next slab is meshed, and is skipped for the slabs without triangles. An
+// exception thrown by the callback stops the extraction and is rethrown.
+template <typename PixelType>
+void extractIsosurfaceSlabs(const PixelType* voxels,
+                            const VolumeGeometry& geometry,
+                            PixelType lower,
+                            PixelType upper,
+                            unsigned int threads,
+                            const SlabCallback& callback,
+                            const BrickGrid<PixelType>* bricks = nullptr);
+
+// Copies the voxels of the slices [first, last) of a volume, in Z order,
+// into a buffer of (last - first) slices.
+template <typename PixelType>
+using SliceLoader = std::function<void(PixelType* target, size_t first, size_t last)>;
+
+// Same as extractIsosurfaces(), for volumes that do not fit in memory: each
+// slab loads its slices, plus the last slice of the previous slab, right
+// before being meshed, so that only "threads" slabs of voxels are held at
+// once. The loader is called from several threads at once, and its
+// exceptions are rethrown.
+template <typename PixelType>
+void extractIsosurfacesOutOfCore(const SliceLoader<PixelType>& loader,
+                                 const VolumeGeometry& geometry,
+                                 const ValueRanges<PixelType>& ranges,
+                                 unsigned int threads,
+                                 std::vector<TriangleMesh>& targets);
+
+// Same as extractIsosurfaceSlabs(), loading the slices of each slab as
+// extractIsosurfacesOutOfCore() does. The slabs are handed over in order,
+// so that a streamed surface never needs the whole volume either.
+template <typename PixelType>
+void extractIsosurfaceSlabsOutOfCore(const SliceLoader<PixelType>& loader,
+                                     const VolumeGeometry& geometry,
+                                     PixelType lower,
+                                     PixelType upper,
+                                     unsigned int threads,
+                                     const SlabCallback& callback);
+
+#endif
@@ -0,0 +1,216 @@
+#include "MeshOrdering.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+    constexpr uint32_t NoPoint = UINT32_MAX;
+
+    // Bit pattern of a position, so that points are merged only when equal
+    struct PositionKey {
+        uint32_t bits[3];
+
+        bool operator==(const PositionKey& other) const {
+            return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+        }
+    };
+
+    struct PositionHash {
+        size_t operator()(const PositionKey& key) const {
+            uint64_t hash = 14695981039346656037ull;
+            for (uint32_t bits : key.bits) {
+                hash = (hash ^ bits) * 1099511628211ull;
+            }
+            return static_cast<size_t>(hash ^ (hash >> 32));
+        }
+    };
+
+    // Triangles around every point, as offsets into a single array
+    struct Adjacency {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+
+        explicit Adjacency(const TriangleMesh& mesh) : offsets(mesh.getPointCount() + 1, 0),
+                                                       triangles(mesh.triangles.size()) {
+            for (uint32_t v : mesh.triangles) {
+                offsets[v + 1]++;
+            }
+            for (size_t v = 1; v < offsets.size(); ++v) {
+                offsets[v] += offsets[v - 1];
+            }
+
+            std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < mesh.triangles.size(); ++i) {
+                triangles[next[mesh.triangles[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+    };
+
+    // Tipsify, returning the triangles in their new order
+    std::vector<uint32_t> tipsify(const TriangleMesh& mesh, size_t cacheSize) {
+        const size_t pointCount = mesh.getPointCount();
+        const Adjacency adjacency(mesh);
+
+        std::vector<uint32_t> live(pointCount);          // Triangles left to emit around each point
+        for (size_t v = 0; v < pointCount; ++v) {
+            live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+        }
+
+        std::vector<size_t> timestamps(pointCount, 0);   // When each point last entered the cache
+        std::vector<uint8_t> emitted(mesh.getTriangleCount(), 0);
+        std::vector<uint32_t> deadEnd;                   // Recently used points, to restart from
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> order;
+        order.reserve(mesh.getTriangleCount());
+
+        size_t time = cacheSize + 1;
+        size_t cursor = 0;                               // Points before it have no triangle left
+
+        uint32_t fan = 0;
+        while (fan != NoPoint) {
+            candidates.clear();
+
+            for (uint32_t i = adjacency.offsets[fan]; i < adjacency.offsets[fan + 1]; ++i) {
+                const uint32_t t = adjacency.triangles[i];
+                if (emitted[t]) {
+                    continue;
+                }
+
+                emitted[t] = 1;
+                order.push_back(t);
+
+                for (size_t k = 0; k < 3; ++k) {
+                    const uint32_t v = mesh.triangles[3 * t + k];
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if (time - timestamps[v] > cacheSize) {
+                        timestamps[v] = time++;
+                    }
+                }
+            }
+
+            // The next fan is the candidate that stays in the cache the
+            // longest while its triangles are emitted
+            fan = NoPoint;
+            long best = -1;
+            for (uint32_t v : candidates) {
+                if (live[v] == 0) {
+                    continue;
+                }
+
+                long priority = 0;
+                if (time - timestamps[v] + 2 * live[v] <= cacheSize) {
+                    priority = static_cast<long>(time - timestamps[v]);
+                }
+                if (priority > best) {
+                    best = priority;
+                    fan = v;
+                }
+            }
+
+            // Otherwise, a recently used point, or the next one left
+            while (fan == NoPoint && !deadEnd.empty()) {
+                const uint32_t v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0) {
+                    fan = v;
+                }
+            }
+
+            while (fan == NoPoint && cursor < pointCount) {
+                if (live[cursor] > 0) {
+                    fan = static_cast<uint32_t>(cursor);
+                } else {
+                    ++cursor;
+                }
+            }
+        }
+
+        return order;
+    }
+}
+
+void weldPoints(TriangleMesh& mesh) {
+    const size_t pointCount = mesh.getPointCount();
+    const bool normals = mesh.hasNormals();
+
+    std::unordered_map<PositionKey, uint32_t, PositionHash> welded;
+    welded.reserve(pointCount);
+
+    std::vector<uint32_t> remap(pointCount);
+    uint32_t next = 0;
+    for (size_t v = 0; v < pointCount; ++v) {
+        PositionKey key;
+        std::memcpy(key.bits, &mesh.points[3 * v], sizeof(key.bits));
+
+        const auto found = welded.emplace(key, next);
+        if (found.second) {
+            std::copy(&mesh.points[3 * v], &mesh.points[3 * v] + 3, &mesh.points[3 * next]);
+            if (normals) {
+                std::copy(&mesh.normals[3 * v], &mesh.normals[3 * v] + 3, &mesh.normals[3 * next]);
+            }
+            ++next;
+        }
+        remap[v] = found.first->second;
+    }
+
+    mesh.points.resize(3 * next);
+    if (normals) {
+        mesh.normals.resize(3 * next);
+    }
+
+    size_t kept = 0;
+    for (size_t t = 0; t < mesh.getTriangleCount(); ++t) {
+        const uint32_t a = remap[mesh.triangles[3 * t]];
+        const uint32_t b = remap[mesh.triangles[3 * t + 1]];
+        const uint32_t c = remap[mesh.triangles[3 * t + 2]];
+        if (a != b && b != c && a != c) {
+            mesh.triangles[3 * kept] = a;
+            mesh.triangles[3 * kept + 1] = b;
+            mesh.triangles[3 * kept + 2] = c;
+            ++kept;
+        }
+    }
+    mesh.triangles.resize(3 * kept);
+}
+
+void optimizeVertexOrder(TriangleMesh& mesh, size_t cacheSize) {
+    if (mesh.triangles.empty()) {
+        return;
+    }
+
+    const std::vector<uint32_t> order = tipsify(mesh, cacheSize);
+    const bool normals = mesh.hasNormals();
+
+    std::vector<uint32_t> remap(mesh.getPointCount(), NoPoint);
+    std::vector<uint32_t> triangles(mesh.triangles.size());
+    std::vector<float> points;
+    std::vector<float> pointNormals;
+    points.reserve(mesh.points.size());
+    if (normals) {
+        pointNormals.reserve(mesh.normals.size());
+    }
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (size_t k = 0; k < 3; ++k) {
+            const uint32_t v = mesh.triangles[3 * order[i] + k];
+            if (remap[v] == NoPoint) {
+                remap[v] = static_cast<uint32_t>(points.size() / 3);
+                points.insert(points.end(), &mesh.points[3 * v], &mesh.points[3 * v] + 3);
+                if (normals) {
+                    pointNormals.insert(pointNormals.end(), &mesh.normals[3 * v], &mesh.normals[3 * v] + 3);
+                }
+            }
+            triangles[3 * i + k] = remap[v];
+        }
+    }
+
+    mesh.points.swap(points);
+    mesh.triangles.swap(triangles);
+    mesh.normals.swap(pointNormals);
+}
@@ -0,0 +1,20 @@
+#ifndef DICOMITKLIBRARY_MESHORDERING_H
+#define DICOMITKLIBRARY_MESHORDERING_H
+
+#include <cstddef>
+#include "TriangleMesh.h"
+
+// Merges the points that have the very same position, and drops the
+// triangles that collapse as a result. Marching cubes already shares the
+// vertex of every edge, so this is only needed for meshes built otherwise.
+void weldPoints(TriangleMesh& mesh);
+
+// Reorders the triangles for the post-transform vertex cache of the GPU,
+// with Tipsify (Sander, Nehab and Barczak, 2007): triangles are emitted in
+// fans around the vertices most likely to still be in a cache of
+// "cacheSize" vertices. The points are then renumbered in the order the
+// triangles first use them, for the locality of the vertex fetches, and
+// the points no triangle uses are dropped. Runs in linear time.
+void optimizeVertexOrder(TriangleMesh& mesh, size_t cacheSize = 16);
+
+#endif
@@ -0,0 +1,646 @@
+#include "MeshWriters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// The vector kernels are compiled for their instruction set only, and
+// picked at run time, so the library still runs on older CPUs
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DICOMITK_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace {
+
+    bool isLittleEndian() {
+        const uint32_t word = 1;
+        uint8_t first;
+        std::memcpy(&first, &word, 1);
+        return first == 1;
+    }
+
+    typedef void (*SwapFunction)(uint8_t* bytes, size_t count);
+
+    // Reverses the bytes of the 32-bit words from "first" on, one at a time
+    void swapScalar(uint8_t* bytes, size_t count, size_t first) {
+        for (size_t i = first; i < count; ++i) {
+            uint32_t word;
+            std::memcpy(&word, bytes + 4 * i, 4);
+            word = (word >> 24) | ((word >> 8) & 0x0000ff00u) | ((word << 8) & 0x00ff0000u) | (word << 24);
+            std::memcpy(bytes + 4 * i, &word, 4);
+        }
+    }
+
+    void swapScalar(uint8_t* bytes, size_t count) {
+        swapScalar(bytes, count, 0);
+    }
+
+#ifdef DICOMITK_X86_KERNELS
+    // One byte shuffle per 4 words
+    __attribute__((target("ssse3")))
+    void swapSsse3(uint8_t* bytes, size_t count) {
+        const __m128i reverse = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i* block = reinterpret_cast<__m128i*>(bytes + 4 * i);
+            _mm_storeu_si128(block, _mm_shuffle_epi8(_mm_loadu_si128(block), reverse));
+        }
+
+        swapScalar(bytes, count, i);
+    }
+
+    // Same as above, per 8 words, the shuffle working within 128-bit lanes
+    __attribute__((target("avx2")))
+    void swapAvx2(uint8_t* bytes, size_t count) {
+        const __m256i reverse = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                                 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i* block = reinterpret_cast<__m256i*>(bytes + 4 * i);
+            _mm256_storeu_si256(block, _mm256_shuffle_epi8(_mm256_loadu_si256(block), reverse));
+        }
+
+        swapScalar(bytes, count, i);
+    }
+#endif
+
+    SwapFunction selectSwapFunction() {
+#ifdef DICOMITK_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return swapAvx2;
+        }
+        if (__builtin_cpu_supports("ssse3")) {
+            return swapSsse3;
+        }
+#endif
+        return swapScalar;
+    }
+
+    // Reverses the bytes of "count" consecutive 32-bit words
+    void swapWords(void* data, size_t count) {
+        static const SwapFunction swap = selectSwapFunction();
+        swap(static_cast<uint8_t*>(data), count);
+    }
+
+    // Appends 32-bit words in big-endian order, as legacy VTK expects them
+    void appendBigEndian(std::string& target, const void* words, size_t count) {
+        const size_t offset = target.size();
+        target.resize(offset + 4 * count);
+        if (count == 0) {
+            return;
+        }
+
+        std::memcpy(&target[offset], words, 4 * count);
+        if (isLittleEndian()) {
+            swapWords(&target[offset], count);
+        }
+    }
+
+    void appendFormatted(std::string& target, const char* format, size_t first, size_t second = 0) {
+        char buffer[128];
+        const int length = snprintf(buffer, sizeof(buffer), format, first, second);
+        target.append(buffer, static_cast<size_t>(length));
+    }
+
+    // Longest "%.9g" rendering of a float, plus its separator
+    constexpr size_t MaxCoordinateLength = 16;
+    // Longest 32-bit point id, plus its separator
+    constexpr size_t MaxPointIdLength = 11;
+
+    const char* const VtkHeader = "# vtk DataFile Version 2.0\n"
+                                  "File written by dicomtoitk\n";
+
+    // The buffer is sized once from an upper bound computed from the point
+    // and triangle counts, filled in a single pass and trimmed at the end.
+    void writeVtkAscii(const TriangleMesh& mesh, std::string& target) {
+        const size_t pointCount = mesh.getPointCount();
+        const size_t triangleCount = mesh.getTriangleCount();
+
+        size_t upperBound = 256 + pointCount * 3 * MaxCoordinateLength + triangleCount * (2 + 3 * MaxPointIdLength);
+        if (mesh.hasNormals()) {
+            upperBound += 64 + pointCount * 3 * MaxCoordinateLength;
+        }
+
+        target.resize(upperBound);
+        char* begin = &target[0];
+        char* cursor = begin;
+
+        cursor += sprintf(cursor, "%s"
+                                  "ASCII\n"
+                                  "DATASET POLYDATA\n"
+                                  "POINTS %zu float\n", VtkHeader, pointCount);
+
+        for (size_t i = 0; i + 2 < mesh.points.size(); i += 3) {
+            cursor += sprintf(cursor, "%.9g %.9g %.9g\n", mesh.points[i], mesh.points[i + 1], mesh.points[i + 2]);
+        }
+
+        cursor += sprintf(cursor, "POLYGONS %zu %zu\n", triangleCount, 4 * triangleCount);
+
+        for (size_t i = 0; i + 2 < mesh.triangles.size(); i += 3) {
+            cursor += sprintf(cursor, "3 %u %u %u\n", mesh.triangles[i], mesh.triangles[i + 1], mesh.triangles[i + 2]);
+        }
+
+        if (mesh.hasNormals()) {
+            cursor += sprintf(cursor, "POINT_DATA %zu\n"
+                                      "NORMALS Normals float\n", pointCount);
+
+            for (size_t i = 0; i + 2 < mesh.normals.size(); i += 3) {
+                cursor += sprintf(cursor, "%.9g %.9g %.9g\n", mesh.normals[i], mesh.normals[i + 1], mesh.normals[i + 2]);
+            }
+        }
+
+        target.resize(static_cast<size_t>(cursor - begin));
+    }
+
+    void writeVtkBinary(const TriangleMesh& mesh, std::string& target) {
+        const size_t pointCount = mesh.getPointCount();
+        const size_t triangleCount = mesh.getTriangleCount();
+
+        target.clear();
+        target.reserve(256 + 12 * pointCount + 16 * triangleCount + (mesh.hasNormals() ? 12 * pointCount : 0));
+
+        target.append(VtkHeader);
+        target.append("BINARY\n"
+                      "DATASET POLYDATA\n");
+
+        appendFormatted(target, "POINTS %zu float\n", pointCount);
+        appendBigEndian(target, mesh.points.data(), 3 * pointCount);
+        target.push_back('\n');
+
+        appendFormatted(target, "POLYGONS %zu %zu\n", triangleCount, 4 * triangleCount);
+
+        // Each cell is prefixed with its number of points: interleave in
+        // native order, then swap the whole block at once
+        const size_t offset = target.size();
+        target.resize(offset + 16 * triangleCount);
+        char* cell = &target[offset];
+        for (size_t i = 0; i < triangleCount; ++i, cell += 16) {
+            const uint32_t record[4] = { 3, mesh.triangles[3 * i], mesh.triangles[3 * i + 1], mesh.triangles[3 * i + 2] };
+            std::memcpy(cell, record, sizeof(record));
+        }
+        if (triangleCount > 0 && isLittleEndian()) {
+            swapWords(&target[offset], 4 * triangleCount);
+        }
+        target.push_back('\n');
+
+        if (mesh.hasNormals()) {
+            appendFormatted(target, "POINT_DATA %zu\n", pointCount);
+            target.append("NORMALS Normals float\n");
+            appendBigEndian(target, mesh.normals.data(), 3 * pointCount);
+            target.push_back('\n');
+        }
+    }
+
+    // Raw appended block: a 64-bit byte count followed by the data, both in
+    // the byte order declared in the header, which is the native one
+    void appendBlock(std::string& target, const void* data, size_t size) {
+        const uint64_t header = size;
+        target.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (size > 0) {
+            target.append(static_cast<const char*>(data), size);
+        }
+    }
+
+    void writeVtp(const TriangleMesh& mesh, std::string& target) {
+        const size_t pointCount = mesh.getPointCount();
+        const size_t triangleCount = mesh.getTriangleCount();
+        const bool normals = mesh.hasNormals();
+
+        if (triangleCount * 3 > INT32_MAX) {
+            throw std::length_error("Too many triangles for 32-bit VTK connectivity");
+        }
+
+        // Offsets of the blocks inside the appended data
+        const size_t pointsOffset = 0;
+        const size_t connectivityOffset = pointsOffset + 8 + 12 * pointCount;
+        const size_t offsetsOffset = connectivityOffset + 8 + 12 * triangleCount;
+        const size_t normalsOffset = offsetsOffset + 8 + 4 * triangleCount;
+        const size_t appendedSize = normalsOffset + (normals ? 8 + 12 * pointCount : 0);
+
+        char xml[2048];
+        int length = snprintf(xml, sizeof(xml),
+                              "<?xml version=\"1.0\"?>\n"
+                              "<VTKFile type=\"PolyData\" version=\"1.0\" byte_order=\"%s\" header_type=\"UInt64\">\n"
+                              "  <PolyData>\n"
+                              "    <Piece NumberOfPoints=\"%zu\" NumberOfVerts=\"0\" NumberOfLines=\"0\" NumberOfStrips=\"0\" NumberOfPolys=\"%zu\">\n",
+                              isLittleEndian() ? "LittleEndian" : "BigEndian", pointCount, triangleCount);
+
+        if (normals) {
+            length += snprintf(xml + length, sizeof(xml) - length,
+                               "      <PointData Normals=\"Normals\">\n"
+                               "        <DataArray type=\"Float32\" Name=\"Normals\" NumberOfComponents=\"3\" format=\"appended\" offset=\"%zu\"/>\n"
+                               "      </PointData>\n", normalsOffset);
+        }
+
+        length += snprintf(xml + length, sizeof(xml) - length,
+                           "      <Points>\n"
+                           "        <DataArray type=\"Float32\" Name=\"Points\" NumberOfComponents=\"3\" format=\"appended\" offset=\"%zu\"/>\n"
+                           "      </Points>\n"
+                           "      <Polys>\n"
+                           "        <DataArray type=\"Int32\" Name=\"connectivity\" format=\"appended\" offset=\"%zu\"/>\n"
+                           "        <DataArray type=\"Int32\" Name=\"offsets\" format=\"appended\" offset=\"%zu\"/>\n"
+                           "      </Polys>\n"
+                           "    </Piece>\n"
+                           "  </PolyData>\n"
+                           "  <AppendedData encoding=\"raw\">\n"
+                           "   _", pointsOffset, connectivityOffset, offsetsOffset);
+
+        static const char* const footer = "\n"
+                                          "  </AppendedData>\n"
+                                          "</VTKFile>\n";
+
+        target.clear();
+        target.reserve(static_cast<size_t>(length) + appendedSize + strlen(footer));
+        target.append(xml, static_cast<size_t>(length));
+
+        appendBlock(target, mesh.points.data(), 12 * pointCount);
+        appendBlock(target, mesh.triangles.data(), 12 * triangleCount);
+
+        // Triangles only, so the end of cell i is at 3 * (i + 1)
+        const uint64_t offsetsSize = 4 * triangleCount;
+        target.append(reinterpret_cast<const char*>(&offsetsSize), sizeof(offsetsSize));
+        const size_t offset = target.size();
+        target.resize(offset + offsetsSize);
+        char* cursor = &target[offset];
+        for (size_t i = 0; i < triangleCount; ++i, cursor += 4) {
+            const int32_t end = static_cast<int32_t>(3 * (i + 1));
+            std::memcpy(cursor, &end, 4);
+        }
+
+        if (normals) {
+            appendBlock(target, mesh.normals.data(), 12 * pointCount);
+        }
+
+        target.append(footer);
+    }
+
+    // Binary PLY in the native byte order. Normals, if any, are interleaved
+    // with the positions, as PLY stores one record per vertex.
+    void writePly(const TriangleMesh& mesh, std::string& target) {
+        const size_t pointCount = mesh.getPointCount();
+        const size_t triangleCount = mesh.getTriangleCount();
+        const bool normals = mesh.hasNormals();
+
+        char header[512];
+        const int length = snprintf(header, sizeof(header),
+                                    "ply\n"
+                                    "format %s 1.0\n"
+                                    "comment File written by dicomtoitk\n"
+                                    "element vertex %zu\n"
+                                    "property float x\n"
+                                    "property float y\n"
+                                    "property float z\n"
+                                    "%s"
+                                    "element face %zu\n"
+                                    "property list uchar uint vertex_indices\n"
+                                    "end_header\n",
+                                    isLittleEndian() ? "binary_little_endian" : "binary_big_endian",
+                                    pointCount,
+                                    normals ? "property float nx\nproperty float ny\nproperty float nz\n" : "",
+                                    triangleCount);
+
+        const size_t vertexSize = normals ? 24 : 12;
+        const size_t faceSize = 1 + 12;
+
+        target.resize(static_cast<size_t>(length) + vertexSize * pointCount + faceSize * triangleCount);
+        char* cursor = &target[0];
+        std::memcpy(cursor, header, static_cast<size_t>(length));
+        cursor += length;
+
+        if (normals) {
+            for (size_t i = 0; i < pointCount; ++i, cursor += vertexSize) {
+                std::memcpy(cursor, &mesh.points[3 * i], 12);
+                std::memcpy(cursor + 12, &mesh.normals[3 * i], 12);
+            }
+        } else if (pointCount > 0) {
+            std::memcpy(cursor, mesh.points.data(), 12 * pointCount);
+            cursor += 12 * pointCount;
+        }
+
+        for (size_t i = 0; i < triangleCount; ++i, cursor += faceSize) {
+            *cursor = 3;
+            std::memcpy(cursor + 1, &mesh.triangles[3 * i], 12);
+        }
+    }
+
+    // Binary STL is little-endian and repeats the three vertices and the
+    // facet normal in each 50-byte record
+    void writeStl(const TriangleMesh& mesh, std::string& target) {
+        const size_t triangleCount = mesh.getTriangleCount();
+        if (triangleCount > UINT32_MAX) {
+            throw std::length_error("Too many triangles for binary STL");
+        }
+
+        target.assign(80, '\0');
+        static const char* const header = "Binary STL written by dicomtoitk";
+        target.replace(0, strlen(header), header);
+
+        const uint32_t count = static_cast<uint32_t>(triangleCount);
+        target.append(reinterpret_cast<const char*>(&count), 4);
+        if (!isLittleEndian()) {
+            swapWords(&target[80], 1);
+        }
+
+        const size_t offset = target.size();
+        target.resize(offset + 50 * triangleCount);
+        char* cursor = &target[offset];
+
+        for (size_t i = 0; i < triangleCount; ++i, cursor += 50) {
+            float record[12];
+            for (size_t k = 0; k < 3; ++k) {
+                std::memcpy(&record[3 + 3 * k], &mesh.points[3 * mesh.triangles[3 * i + k]], 12);
+            }
+
+            const float u[3] = { record[6] - record[3], record[7] - record[4], record[8] - record[5] };
+            const float v[3] = { record[9] - record[3], record[10] - record[4], record[11] - record[5] };
+            record[0] = u[1] * v[2] - u[2] * v[1];
+            record[1] = u[2] * v[0] - u[0] * v[2];
+            record[2] = u[0] * v[1] - u[1] * v[0];
+
+            const float length = std::sqrt(record[0] * record[0] + record[1] * record[1] + record[2] * record[2]);
+            if (length > 0.0f) {
+                record[0] /= length;
+                record[1] /= length;
+                record[2] /= length;
+            }
+
+            if (!isLittleEndian()) {
+                swapWords(record, 12);
+            }
+
+            std::memcpy(cursor, record, sizeof(record));
+            cursor[48] = 0;    // Attribute byte count
+            cursor[49] = 0;
+        }
+    }
+
+    const uint32_t GlbMagic = 0x46546C67;         // "glTF"
+    const uint32_t GlbJsonChunk = 0x4E4F534A;     // "JSON"
+    const uint32_t GlbBinaryChunk = 0x004E4942;   // "BIN\0"
+
+    void appendLittleEndian(std::string& target, uint32_t word) {
+        const size_t offset = target.size();
+        target.append(reinterpret_cast<const char*>(&word), 4);
+        if (!isLittleEndian()) {
+            swapWords(&target[offset], 1);
+        }
+    }
+
+    // Appends 32-bit words in little-endian order, as glTF buffers are
+    void appendLittleEndian(std::string& target, const void* words, size_t count) {
+        const size_t offset = target.size();
+        target.resize(offset + 4 * count);
+        if (count == 0) {
+            return;
+        }
+
+        std::memcpy(&target[offset], words, 4 * count);
+        if (!isLittleEndian()) {
+            swapWords(&target[offset], count);
+        }
+    }
+
+    // Appends 16-bit values in little-endian order
+    void appendLittleEndian(std::string& target, const uint16_t* values, size_t count) {
+        const size_t offset = target.size();
+        target.resize(offset + 2 * count);
+        if (count == 0) {
+            return;
+        }
+
+        std::memcpy(&target[offset], values, 2 * count);
+        if (!isLittleEndian()) {
+            for (size_t i = offset; i < target.size(); i += 2) {
+                std::swap(target[i], target[i + 1]);
+            }
+        }
+    }
+
+    // Positions quantized to 16 bits across the bounding box, padded to 4
+    // values each since vertex attributes are 4-byte aligned in glTF. A flat
+    // side of the box keeps a scale of 1.
+    void quantizePositions(const TriangleMesh& mesh, const float minimum[3], const float maximum[3],
+                           float scale[3], std::vector<uint16_t>& target) {
+        for (size_t k = 0; k < 3; ++k) {
+            const float extent = maximum[k] - minimum[k];
+            scale[k] = (extent > 0.0f ? extent / 65535.0f : 1.0f);
+        }
+
+        target.resize(4 * mesh.getPointCount());
+        for (size_t i = 0; i < mesh.getPointCount(); ++i) {
+            for (size_t k = 0; k < 3; ++k) {
+                const float value = std::round((mesh.points[3 * i + k] - minimum[k]) / scale[k]);
+                target[4 * i + k] = static_cast<uint16_t>(std::min(std::max(value, 0.0f), 65535.0f));
+            }
+            target[4 * i + 3] = 0;
+        }
+    }
+
+    // The node transform scales the quantized positions, and viewers turn
+    // the normals by its inverse transpose: the normals are scaled the other
+    // way round so that they come out unchanged.
+    void scaleNormals(const TriangleMesh& mesh, const float scale[3], std::vector<float>& target) {
+        target.resize(mesh.normals.size());
+        for (size_t i = 0; i < mesh.normals.size(); i += 3) {
+            const float n[3] = { mesh.normals[i] * scale[0], mesh.normals[i + 1] * scale[1],
+                                 mesh.normals[i + 2] * scale[2] };
+            const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (size_t k = 0; k < 3; ++k) {
+                target[i + k] = (length > 0.0f ? n[k] / length : 0.0f);
+            }
+        }
+    }
+
+    // glTF 2.0 binary container with a single indexed triangle primitive.
+    // Positions stay in millimeters in the LPS patient frame; the node
+    // transform maps them to meters in the Y-up frame of glTF. Quantized
+    // positions are unsigned shorts across the bounding box, as in
+    // KHR_mesh_quantization, which the node transform scales back.
+    void writeGlb(const TriangleMesh& mesh, MeshPrecision precision, std::string& target) {
+        const size_t pointCount = mesh.getPointCount();
+        const size_t triangleCount = mesh.getTriangleCount();
+        const bool normals = mesh.hasNormals();
+        const bool quantized = (precision == MeshPrecision_Quantized16 && pointCount > 0 && triangleCount > 0);
+
+        if (pointCount > UINT32_MAX || 3 * triangleCount > UINT32_MAX) {
+            throw std::length_error("Too many points or triangles for glTF");
+        }
+
+        const size_t positionsSize = (quantized ? 8 : 12) * pointCount;
+        const size_t indicesSize = 12 * triangleCount;
+        const size_t normalsSize = normals ? 12 * pointCount : 0;
+        const size_t binarySize = positionsSize + indicesSize + normalsSize;
+
+        std::vector<uint16_t> positions;
+        std::vector<float> scaledNormals;
+
+        std::string json;
+        char buffer[1024];
+
+        if (pointCount == 0 || triangleCount == 0) {
+            // Accessors cannot be empty, so an empty mesh is an empty scene
+            json = "{\"asset\":{\"version\":\"2.0\",\"generator\":\"dicomtoitk\"},\"scene\":0,\"scenes\":[{}]}";
+        } else {
+            float minimum[3] = { mesh.points[0], mesh.points[1], mesh.points[2] };
+            float maximum[3] = { mesh.points[0], mesh.points[1], mesh.points[2] };
+            for (size_t i = 0; i < mesh.points.size(); i += 3) {
+                for (size_t k = 0; k < 3; ++k) {
+                    minimum[k] = std::min(minimum[k], mesh.points[i + k]);
+                    maximum[k] = std::max(maximum[k], mesh.points[i + k]);
+                }
+            }
+
+            // Column-major, from patient millimeters to glTF meters
+            float matrix[16] = { 0.001f, 0, 0, 0, 0, 0, -0.001f, 0, 0, 0.001f, 0, 0, 0, 0, 0, 1 };
+            if (quantized) {
+                float scale[3];
+                quantizePositions(mesh, minimum, maximum, scale, positions);
+                if (normals) {
+                    scaleNormals(mesh, scale, scaledNormals);
+                }
+
+                for (size_t k = 0; k < 3; ++k) {
+                    for (size_t row = 0; row < 3; ++row) {
+                        matrix[12 + row] += matrix[4 * k + row] * minimum[k];
+                        matrix[4 * k + row] *= scale[k];
+                    }
+                }
+            }
+
+            snprintf(buffer, sizeof(buffer),
+                     "{\"asset\":{\"version\":\"2.0\",\"generator\":\"dicomtoitk\"},%s"
+                     "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+                     "\"nodes\":[{\"mesh\":0,\"matrix\":[%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,"
+                     "%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g]}],"
+                     "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0%s},\"indices\":1,\"mode\":4}]}],"
+                     "\"buffers\":[{\"byteLength\":%zu}],",
+                     quantized ? "\"extensionsUsed\":[\"KHR_mesh_quantization\"],"
+                                 "\"extensionsRequired\":[\"KHR_mesh_quantization\"]," : "",
+                     matrix[0], matrix[1], matrix[2], matrix[3], matrix[4], matrix[5], matrix[6], matrix[7],
+                     matrix[8], matrix[9], matrix[10], matrix[11], matrix[12], matrix[13], matrix[14], matrix[15],
+                     normals ? ",\"NORMAL\":2" : "", binarySize);
+            json = buffer;
+
+            snprintf(buffer, sizeof(buffer),
+                     "\"bufferViews\":["
+                     "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%zu,%s\"target\":34962},"
+                     "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"target\":34963}",
+                     positionsSize, quantized ? "\"byteStride\":8," : "", positionsSize, indicesSize);
+            json += buffer;
+
+            if (normals) {
+                snprintf(buffer, sizeof(buffer),
+                         ",{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"target\":34962}",
+                         positionsSize + indicesSize, normalsSize);
+                json += buffer;
+            }
+
+            if (quantized) {
+                uint16_t low[3] = { 65535, 65535, 65535 };
+                uint16_t high[3] = { 0, 0, 0 };
+                for (size_t i = 0; i < positions.size(); i += 4) {
+                    for (size_t k = 0; k < 3; ++k) {
+                        low[k] = std::min(low[k], positions[i + k]);
+                        high[k] = std::max(high[k], positions[i + k]);
+                    }
+                }
+
+                snprintf(buffer, sizeof(buffer),
+                         "],\"accessors\":["
+                         "{\"bufferView\":0,\"componentType\":5123,\"count\":%zu,\"type\":\"VEC3\","
+                         "\"min\":[%u,%u,%u],\"max\":[%u,%u,%u]},",
+                         pointCount, low[0], low[1], low[2], high[0], high[1], high[2]);
+            } else {
+                snprintf(buffer, sizeof(buffer),
+                         "],\"accessors\":["
+                         "{\"bufferView\":0,\"componentType\":5126,\"count\":%zu,\"type\":\"VEC3\","
+                         "\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]},",
+                         pointCount, minimum[0], minimum[1], minimum[2], maximum[0], maximum[1], maximum[2]);
+            }
+            json += buffer;
+
+            snprintf(buffer, sizeof(buffer),
+                     "{\"bufferView\":1,\"componentType\":5125,\"count\":%zu,\"type\":\"SCALAR\"}",
+                     3 * triangleCount);
+            json += buffer;
+
+            if (normals) {
+                snprintf(buffer, sizeof(buffer),
+                         ",{\"bufferView\":2,\"componentType\":5126,\"count\":%zu,\"type\":\"VEC3\"}",
+                         pointCount);
+                json += buffer;
+            }
+
+            json += "]}";
+        }
+
+        // Chunks are 4-byte aligned, JSON being padded with spaces
+        json.append((4 - json.size() % 4) % 4, ' ');
+        const bool binary = (binarySize > 0 && triangleCount > 0);
+        const size_t totalSize = 12 + 8 + json.size() + (binary ? 8 + binarySize : 0);
+
+        if (totalSize > UINT32_MAX) {
+            throw std::length_error("Mesh too large for a GLB container");
+        }
+
+        target.clear();
+        target.reserve(totalSize);
+
+        appendLittleEndian(target, GlbMagic);
+        appendLittleEndian(target, 2);
+        appendLittleEndian(target, static_cast<uint32_t>(totalSize));
+
+        appendLittleEndian(target, static_cast<uint32_t>(json.size()));
+        appendLittleEndian(target, GlbJsonChunk);
+        target.append(json);
+
+        if (binary) {
+            // Every block is a multiple of 4 bytes, so the chunk needs no padding
+            appendLittleEndian(target, static_cast<uint32_t>(binarySize));
+            appendLittleEndian(target, GlbBinaryChunk);
+            if (quantized) {
+                appendLittleEndian(target, positions.data(), positions.size());
+            } else {
+                appendLittleEndian(target, mesh.points.data(), 3 * pointCount);
+            }
+            appendLittleEndian(target, mesh.triangles.data(), 3 * triangleCount);
+            if (normals) {
+                appendLittleEndian(target, quantized ? scaledNormals.data() : mesh.normals.data(), 3 * pointCount);
+            }
+        }
+    }
+}
+
+void serializeMesh(const TriangleMesh& mesh, MeshFormat format, std::string& target, MeshPrecision precision) {
+    switch (format) {
+        case MeshFormat_VtkAscii:
+            writeVtkAscii(mesh, target);
+            break;
+        case MeshFormat_VtkBinary:
+            writeVtkBinary(mesh, target);
+            break;
+        case MeshFormat_Vtp:
+            writeVtp(mesh, target);
+            break;
+        case MeshFormat_Ply:
+            writePly(mesh, target);
+            break;
+        case MeshFormat_Stl:
+            writeStl(mesh, target);
+            break;
+        case MeshFormat_Glb:
+            writeGlb(mesh, precision, target);
+            break;
+        default:
+            throw std::invalid_argument("Unknown mesh format");
+    }
+}
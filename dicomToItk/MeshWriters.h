@@ -0,0 +1,28 @@
+#ifndef DICOMITKLIBRARY_MESHWRITERS_H
+#define DICOMITKLIBRARY_MESHWRITERS_H
+
+#include <string>
+#include "TriangleMesh.h"
+
+enum MeshFormat {
+    MeshFormat_VtkAscii,     // Legacy VTK polydata, ASCII
+    MeshFormat_VtkBinary,    // Legacy VTK polydata, big-endian binary
+    MeshFormat_Vtp,          // VTK XML polydata, raw appended data
+    MeshFormat_Ply,          // Stanford PLY, binary
+    MeshFormat_Stl,          // STL, binary, unindexed
+    MeshFormat_Glb           // glTF 2.0 binary container, indexed geometry
+};
+
+enum MeshPrecision {
+    MeshPrecision_Float32,       // 32-bit floating-point positions
+    MeshPrecision_Quantized16    // 16-bit positions across the bounding box
+};
+
+// Serializes the mesh into the target buffer, replacing its content. Binary
+// formats are sized up front and filled with a few bulk copies. Only glTF
+// has a quantized encoding, through KHR_mesh_quantization; the other
+// formats keep 32-bit positions whatever the precision.
+void serializeMesh(const TriangleMesh& mesh, MeshFormat format, std::string& target,
+                   MeshPrecision precision = MeshPrecision_Float32);
+
+#endif
@@ -0,0 +1,113 @@
+#include "PackedMask.h"
+
+// The vector kernels are compiled for their instruction set only, and
+// picked at run time, so the library still runs on older CPUs
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DICOMITK_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace {
+
+    typedef void (*PackFunction)(const unsigned short* values, size_t count,
+                                 unsigned short lower, unsigned short upper, uint64_t* target);
+
+    // Packs the words from "first" on one value at a time
+    void packScalar(const unsigned short* values, size_t count,
+                    unsigned short lower, unsigned short upper, uint64_t* target, size_t first) {
+        const size_t words = getMaskWords(count);
+        for (size_t w = first; w < words; ++w) {
+            const size_t end = (w + 1 < words ? (w + 1) * MaskWordBits : count);
+            uint64_t word = 0;
+            for (size_t x = w * MaskWordBits; x < end; ++x) {
+                if (values[x] >= lower && values[x] <= upper) {
+                    word |= uint64_t(1) << (x % MaskWordBits);
+                }
+            }
+            target[w] = word;
+        }
+    }
+
+    void packScalar(const unsigned short* values, size_t count,
+                    unsigned short lower, unsigned short upper, uint64_t* target) {
+        packScalar(values, count, lower, upper, target, 0);
+    }
+
+#ifdef DICOMITK_X86_KERNELS
+    // A value lies in the range if clamping it to the range leaves it as is.
+    // The comparisons give 16-bit lanes of all ones, narrowed to bytes for
+    // the byte mask instruction.
+    __attribute__((target("sse4.1")))
+    void packSse41(const unsigned short* values, size_t count,
+                   unsigned short lower, unsigned short upper, uint64_t* target) {
+        const __m128i low = _mm_set1_epi16(static_cast<short>(lower));
+        const __m128i high = _mm_set1_epi16(static_cast<short>(upper));
+
+        const size_t fullWords = count / MaskWordBits;
+        for (size_t w = 0; w < fullWords; ++w) {
+            const unsigned short* word = values + w * MaskWordBits;
+            uint64_t bits = 0;
+            for (size_t b = 0; b < MaskWordBits; b += 16) {
+                const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(word + b));
+                const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(word + b + 8));
+                const __m128i firstIn = _mm_cmpeq_epi16(_mm_min_epu16(_mm_max_epu16(first, low), high), first);
+                const __m128i secondIn = _mm_cmpeq_epi16(_mm_min_epu16(_mm_max_epu16(second, low), high), second);
+                bits |= static_cast<uint64_t>(static_cast<unsigned int>(
+                        _mm_movemask_epi8(_mm_packs_epi16(firstIn, secondIn)))) << b;
+            }
+            target[w] = bits;
+        }
+
+        packScalar(values, count, lower, upper, target, fullWords);
+    }
+
+    // Same as above, the narrowing working within 128-bit lanes, hence the
+    // permutation that puts the bytes back in order
+    __attribute__((target("avx2")))
+    void packAvx2(const unsigned short* values, size_t count,
+                  unsigned short lower, unsigned short upper, uint64_t* target) {
+        const __m256i low = _mm256_set1_epi16(static_cast<short>(lower));
+        const __m256i high = _mm256_set1_epi16(static_cast<short>(upper));
+
+        const size_t fullWords = count / MaskWordBits;
+        for (size_t w = 0; w < fullWords; ++w) {
+            const unsigned short* word = values + w * MaskWordBits;
+            uint64_t bits = 0;
+            for (size_t b = 0; b < MaskWordBits; b += 32) {
+                const __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(word + b));
+                const __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(word + b + 16));
+                const __m256i firstIn = _mm256_cmpeq_epi16(_mm256_min_epu16(_mm256_max_epu16(first, low), high), first);
+                const __m256i secondIn = _mm256_cmpeq_epi16(_mm256_min_epu16(_mm256_max_epu16(second, low), high), second);
+                const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(firstIn, secondIn), 0xd8);
+                bits |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(packed))) << b;
+            }
+            target[w] = bits;
+        }
+
+        packScalar(values, count, lower, upper, target, fullWords);
+    }
+#endif
+
+    PackFunction selectPackFunction() {
+#ifdef DICOMITK_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return packAvx2;
+        }
+        if (__builtin_cpu_supports("sse4.1")) {
+            return packSse41;
+        }
+#endif
+        return packScalar;
+    }
+}
+
+template <>
+void packRangeMask<unsigned short>(const unsigned short* values,
+                                   size_t count,
+                                   unsigned short lower,
+                                   unsigned short upper,
+                                   uint64_t* target) {
+    static const PackFunction pack = selectPackFunction();
+    pack(values, count, lower, upper, target);
+}
@@ -0,0 +1,48 @@
+#ifndef DICOMITKLIBRARY_PACKEDMASK_H
+#define DICOMITKLIBRARY_PACKEDMASK_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary masks are packed 64 voxels per word: voxel x of a row is bit
+// (x % 64) of word x / 64, the bits past the end of the row being cleared.
+constexpr size_t MaskWordBits = 64;
+
+inline size_t getMaskWords(size_t count) {
+    return (count + MaskWordBits - 1) / MaskWordBits;
+}
+
+inline uint64_t getMaskBit(const uint64_t* row, size_t x) {
+    return (row[x / MaskWordBits] >> (x % MaskWordBits)) & 1;
+}
+
+// Sets the bit of every value that lies in [lower, upper], filling
+// getMaskWords(count) words of the target.
+template <typename PixelType>
+void packRangeMask(const PixelType* values,
+                   size_t count,
+                   PixelType lower,
+                   PixelType upper,
+                   uint64_t* target) {
+    for (size_t w = 0; w < getMaskWords(count); ++w) {
+        const size_t end = (w + 1 < getMaskWords(count) ? (w + 1) * MaskWordBits : count);
+        uint64_t word = 0;
+        for (size_t x = w * MaskWordBits; x < end; ++x) {
+            if (values[x] >= lower && values[x] <= upper) {
+                word |= uint64_t(1) << (x % MaskWordBits);
+            }
+        }
+        target[w] = word;
+    }
+}
+
+// Same as above with AVX2 or SSE4.1, whichever the CPU has, 32 or 16
+// values at a time.
+template <>
+void packRangeMask<unsigned short>(const unsigned short* values,
+                                   size_t count,
+                                   unsigned short lower,
+                                   unsigned short upper,
+                                   uint64_t* target);
+
+#endif
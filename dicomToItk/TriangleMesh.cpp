@@ -0,0 +1,43 @@
+#include "TriangleMesh.h"
+
+#include <cmath>
+
+void TriangleMesh::computeNormals() {
+    normals.assign(points.size(), 0.0f);
+
+    for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+        const float* a = &points[3 * triangles[i]];
+        const float* b = &points[3 * triangles[i + 1]];
+        const float* c = &points[3 * triangles[i + 2]];
+
+        const float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        const float v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+
+        // Not normalized: its length is twice the area of the triangle
+        const float n[3] = { u[1] * v[2] - u[2] * v[1],
+                             u[2] * v[0] - u[0] * v[2],
+                             u[0] * v[1] - u[1] * v[0] };
+
+        for (size_t k = 0; k < 3; ++k) {
+            float* target = &normals[3 * triangles[i + k]];
+            target[0] += n[0];
+            target[1] += n[1];
+            target[2] += n[2];
+        }
+    }
+
+    for (size_t i = 0; i < normals.size(); i += 3) {
+        const float length = std::sqrt(normals[i] * normals[i] + normals[i + 1] * normals[i + 1] + normals[i + 2] * normals[i + 2]);
+        if (length > 0.0f) {
+            normals[i] /= length;
+            normals[i + 1] /= length;
+            normals[i + 2] /= length;
+        }
+    }
+}
+
+void TriangleMesh::shrinkToFit() {
+    points.shrink_to_fit();
+    triangles.shrink_to_fit();
+    normals.shrink_to_fit();
+}
@@ -0,0 +1,41 @@
+#ifndef DICOMITKLIBRARY_TRIANGLEMESH_H
+#define DICOMITKLIBRARY_TRIANGLEMESH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Indexed triangle mesh stored as flat arrays, so that writers can hand whole
+// blocks to the output instead of walking one object per point or per cell.
+struct TriangleMesh {
+    std::vector<float> points;          // x, y, z of each point, in patient coordinates
+    std::vector<uint32_t> triangles;    // Three point indices per triangle, counter-clockwise seen from outside
+    std::vector<float> normals;         // Unit normal of each point, or empty
+
+    size_t getPointCount() const {
+        return points.size() / 3;
+    }
+
+    size_t getTriangleCount() const {
+        return triangles.size() / 3;
+    }
+
+    bool hasNormals() const {
+        return !normals.empty() && normals.size() == points.size();
+    }
+
+    void clear() {
+        points.clear();
+        triangles.clear();
+        normals.clear();
+    }
+
+    // Fills "normals" with the area-weighted average of the normals of the
+    // triangles around each point.
+    void computeNormals();
+
+    // Releases the spare capacity left over by the mesh extraction.
+    void shrinkToFit();
+};
+
+#endif
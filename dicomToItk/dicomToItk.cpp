@@ -1,34 +1,1386 @@
 #include "dicomToItk.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <type_traits>
+#include <utility>
 #include <itkImage.h>
 #include <itkImageSeriesReader.h>
 #include <itkGDCMImageIO.h>
 #include <itkGDCMSeriesFileNames.h>
-#include <itkMeshFileWriter.h>
 #include <itkBinaryMask3DMeshSource.h>
+#include <gdcmImageReader.h>
 #include "itkMesh.h"
+#include "Decimation.h"
+#include "MarchingCubes.h"
+#include "MeshOrdering.h"
 
+constexpr unsigned int Dimension = 3;
+template <typename PixelType>
+using ImageType = itk::Image< PixelType, Dimension >;
+// The points of the meshes ITK builds are floats, as in TriangleMesh
+using MeshTraits = itk::DefaultStaticMeshTraits< float, Dimension, Dimension, float, float >;
+using MeshType = itk::Mesh< float, Dimension, MeshTraits >;
 
-VtkGenerator::VtkGenerator(const char* directory, const char* outputfile)  : directory(std::move(directory)), outputFile(std::move(outputfile)) {}
+// Fraction of the triangles kept from one level of detail to the next
+constexpr double LevelRatio = 0.25;
+
+// Slack on thresholds mapped back onto stored values, for the rounding of
+// the rescale
+constexpr double RescaleTolerance = 1e-6;
+
+// A volume in the type its voxels are stored in, along with the rescale of
+// its stored values, so that the thresholds are mapped onto stored values
+// rather than every voxel onto its actual value.
+class DecodedVolume {
+public:
+    virtual ~DecodedVolume() {}
+
+    virtual size_t getMemoryFootprint() const = 0;
+
+    // Scans the volume for its brick grid, before it gets shared
+    virtual void scanBricks(unsigned int threads) = 0;
+
+    virtual bool extractMeshes(MeshEngine engine, const std::vector<ThresholdRange>& ranges, unsigned int threads,
+                               std::vector<TriangleMesh>& targets) const = 0;
+
+    virtual bool streamMesh(const ThresholdRange& range, unsigned int threads,
+                            const SlabCallback& callback) const = 0;
+};
+
+namespace {
+
+    // Read-only stream buffer over caller-owned memory, so gdcm can parse an
+    // instance without copying it into a std::string first.
+    class MemoryStreamBuffer : public std::streambuf {
+    public:
+        MemoryStreamBuffer(const void* data, size_t size) {
+            char* begin = const_cast<char*>(static_cast<const char*>(data));
+            setg(begin, begin, begin + size);
+        }
+
+    protected:
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+            if (!(which & std::ios_base::in)) {
+                return pos_type(off_type(-1));
+            }
+
+            char* target;
+            switch (dir) {
+                case std::ios_base::beg:
+                    target = eback() + off;
+                    break;
+                case std::ios_base::cur:
+                    target = gptr() + off;
+                    break;
+                default:
+                    target = egptr() + off;
+                    break;
+            }
+
+            if (target < eback() || target > egptr()) {
+                return pos_type(off_type(-1));
+            }
+
+            setg(eback(), target, egptr());
+            return pos_type(target - eback());
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+    };
+
+    // Voxel types the series are meshed in, chosen from the bits allocated
+    // and the pixel representation of their instances
+    enum VoxelType {
+        VoxelType_UInt8,
+        VoxelType_Int16,
+        VoxelType_UInt16,
+        VoxelType_Float32
+    };
+
+    size_t getVoxelSize(VoxelType type) {
+        switch (type) {
+            case VoxelType_UInt8:
+                return 1;
+            case VoxelType_Float32:
+                return 4;
+            default:
+                return 2;
+        }
+    }
+
+    template <typename PixelType>
+    struct VoxelTag {
+        using Type = PixelType;
+    };
+
+    // Calls the function with the tag of the C++ type of these voxels, for
+    // it to run the pipeline instantiated for that type
+    template <typename Function>
+    auto dispatchVoxelType(VoxelType type, Function function) -> decltype(function(VoxelTag<float>())) {
+        switch (type) {
+            case VoxelType_UInt8:
+                return function(VoxelTag<uint8_t>());
+            case VoxelType_Int16:
+                return function(VoxelTag<int16_t>());
+            case VoxelType_UInt16:
+                return function(VoxelTag<uint16_t>());
+            default:
+                return function(VoxelTag<float>());
+        }
+    }
+
+    template <typename PixelType>
+    VoxelType getVoxelType();
+
+    template <>
+    VoxelType getVoxelType<uint8_t>() {
+        return VoxelType_UInt8;
+    }
+
+    template <>
+    VoxelType getVoxelType<int16_t>() {
+        return VoxelType_Int16;
+    }
+
+    template <>
+    VoxelType getVoxelType<uint16_t>() {
+        return VoxelType_UInt16;
+    }
+
+    template <>
+    VoxelType getVoxelType<float>() {
+        return VoxelType_Float32;
+    }
+
+    // Maps the stored values of a series onto the values they mean, such as
+    // Hounsfield units
+    struct Rescale {
+        double slope;
+        double intercept;
+
+        explicit Rescale(double slope = 1.0, double intercept = 0.0) :
+                slope(slope == 0.0 ? 1.0 : slope), intercept(intercept) {}
+
+        bool operator==(const Rescale& other) const {
+            return slope == other.slope && intercept == other.intercept;
+        }
+
+        bool operator!=(const Rescale& other) const {
+            return !(*this == other);
+        }
+    };
+
+    struct DecodedSlice {
+        unsigned int width;
+        unsigned int height;
+        double origin[3];
+        double spacing[2];
+        double cosines[6];
+        double position;
+        VoxelType type;
+        Rescale rescale;
+        std::vector<char> pixels;    // Stored values, row after row
+    };
+
+    // Pixels of a slice as decoded by gdcm or by the caller
+    struct SliceView {
+        VoxelType type;
+        Rescale rescale;
+        unsigned int width;
+        unsigned int height;
+        size_t pitch;
+        const char* buffer;
+    };
+
+    SliceView getView(const DecodedSlice& slice) {
+        SliceView view;
+        view.type = slice.type;
+        view.rescale = slice.rescale;
+        view.width = slice.width;
+        view.height = slice.height;
+        view.pitch = slice.width * getVoxelSize(slice.type);
+        view.buffer = slice.pixels.data();
+        return view;
+    }
+
+    // Value of this type closest to a real one
+    template <typename PixelType>
+    PixelType toStoredValue(double value) {
+        if (std::is_integral<PixelType>::value) {
+            value = std::round(value);
+        }
+
+        value = std::max(value, static_cast<double>(std::numeric_limits<PixelType>::lowest()));
+        value = std::min(value, static_cast<double>(std::numeric_limits<PixelType>::max()));
+        return static_cast<PixelType>(value);
+    }
+
+    // Converts values stored with a rescale into values stored with another
+    template <typename Source, typename Target>
+    void convertValues(const void* raw, size_t count, const Rescale& from, const Rescale& to, Target* target) {
+        const Source* source = static_cast<const Source*>(raw);
+        const double slope = from.slope / to.slope;
+        const double intercept = (from.intercept - to.intercept) / to.slope;
+
+        for (size_t i = 0; i < count; ++i) {
+            target[i] = toStoredValue<Target>(source[i] * slope + intercept);
+        }
+    }
+
+    // Writes the rows of a slice into a volume of this type and rescale,
+    // converting them only if the slice is stored otherwise
+    template <typename PixelType>
+    void storeRows(const SliceView& view, const Rescale& rescale, PixelType* target) {
+        const bool same = (view.type == getVoxelType<PixelType>() && view.rescale == rescale);
+
+        for (unsigned int y = 0; y < view.height; ++y) {
+            const char* row = view.buffer + y * view.pitch;
+            if (same) {
+                std::memcpy(target, row, view.width * sizeof(PixelType));
+            } else {
+                dispatchVoxelType(view.type, [&](auto tag) {
+                    convertValues<typename decltype(tag)::Type>(row, view.width, view.rescale, rescale, target);
+                });
+            }
+            target += view.width;
+        }
+    }
+
+    // Values wider than 16 bits are kept as floats of their actual value
+    template <typename Source>
+    void storeFloats(const std::vector<char>& raw, size_t count, const Rescale& rescale, DecodedSlice& slice) {
+        slice.type = VoxelType_Float32;
+        slice.rescale = Rescale();
+        slice.pixels.resize(count * sizeof(float));
+        convertValues<Source>(raw.data(), count, rescale, slice.rescale, reinterpret_cast<float*>(slice.pixels.data()));
+    }
+
+    bool decodeSlice(const DicomBuffer& instance, DecodedSlice& slice) {
+        MemoryStreamBuffer streamBuffer(instance.data, instance.size);
+        std::istream stream(&streamBuffer);
+
+        gdcm::ImageReader reader;
+        reader.SetStream(stream);
+        if (!reader.Read()) {
+            std::cout << "Cannot parse DICOM instance from memory" << std::endl;
+            return false;
+        }
+
+        const gdcm::Image& image = reader.GetImage();
+        const unsigned int* dimensions = image.GetDimensions();
+        if (image.GetNumberOfDimensions() == 3 && dimensions[2] > 1) {
+            std::cout << "Multi-frame instances are not supported" << std::endl;
+            return false;
+        }
+
+        const gdcm::PixelFormat& format = image.GetPixelFormat();
+        if (format.GetSamplesPerPixel() != 1) {
+            std::cout << "Only grayscale instances can be meshed" << std::endl;
+            return false;
+        }
+
+        slice.width = dimensions[0];
+        slice.height = dimensions[1];
+        std::copy(image.GetOrigin(), image.GetOrigin() + 3, slice.origin);
+        std::copy(image.GetSpacing(), image.GetSpacing() + 2, slice.spacing);
+        std::copy(image.GetDirectionCosines(), image.GetDirectionCosines() + 6, slice.cosines);
+
+        std::vector<char> raw(image.GetBufferLength());
+        if (!image.GetBuffer(raw.data())) {
+            std::cout << "Cannot decode DICOM pixel data" << std::endl;
+            return false;
+        }
+
+        const Rescale rescale(image.GetSlope(), image.GetIntercept());
+        const size_t count = static_cast<size_t>(slice.width) * slice.height;
+
+        // The scalar type follows from the bits allocated and the pixel
+        // representation. 8 and 16-bit values are kept as stored.
+        switch (format.GetScalarType()) {
+            case gdcm::PixelFormat::UINT8:
+                slice.type = VoxelType_UInt8;
+                slice.rescale = rescale;
+                slice.pixels.swap(raw);
+                break;
+            case gdcm::PixelFormat::INT8:
+                slice.type = VoxelType_Int16;
+                slice.rescale = rescale;
+                slice.pixels.resize(count * sizeof(int16_t));
+                convertValues<int8_t>(raw.data(), count, Rescale(), Rescale(),
+                                      reinterpret_cast<int16_t*>(slice.pixels.data()));
+                break;
+            case gdcm::PixelFormat::UINT16:
+                slice.type = VoxelType_UInt16;
+                slice.rescale = rescale;
+                slice.pixels.swap(raw);
+                break;
+            case gdcm::PixelFormat::INT16:
+                slice.type = VoxelType_Int16;
+                slice.rescale = rescale;
+                slice.pixels.swap(raw);
+                break;
+            case gdcm::PixelFormat::UINT32:
+                storeFloats<uint32_t>(raw, count, rescale, slice);
+                break;
+            case gdcm::PixelFormat::INT32:
+                storeFloats<int32_t>(raw, count, rescale, slice);
+                break;
+            case gdcm::PixelFormat::FLOAT32:
+                storeFloats<float>(raw, count, rescale, slice);
+                break;
+            case gdcm::PixelFormat::FLOAT64:
+                storeFloats<double>(raw, count, rescale, slice);
+                break;
+            default:
+                std::cout << "Unsupported DICOM pixel format: " << format << std::endl;
+                return false;
+        }
+
+        if (slice.pixels.size() < count * getVoxelSize(slice.type)) {
+            std::cout << "Truncated DICOM pixel data" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    // Copies a slice whose buffer belongs to the caller
+    DecodedSlice copySlice(const SliceView& view) {
+        DecodedSlice slice;
+        slice.width = view.width;
+        slice.height = view.height;
+        slice.type = view.type;
+        slice.rescale = view.rescale;
+
+        const size_t rowSize = view.width * getVoxelSize(view.type);
+        slice.pixels.resize(rowSize * view.height);
+        for (unsigned int y = 0; y < view.height; ++y) {
+            std::memcpy(slice.pixels.data() + y * rowSize, view.buffer + y * view.pitch, rowSize);
+        }
+        return slice;
+    }
+
+    bool getView(const SlicePixels& pixels, SliceView& view) {
+        switch (pixels.format) {
+            case SliceFormat_UInt8:
+                view.type = VoxelType_UInt8;
+                break;
+            case SliceFormat_UInt16:
+                view.type = VoxelType_UInt16;
+                break;
+            case SliceFormat_Int16:
+                view.type = VoxelType_Int16;
+                break;
+            default:
+                std::cout << "Unsupported slice format: " << pixels.format << std::endl;
+                return false;
+        }
+
+        view.rescale = Rescale(pixels.slope, pixels.intercept);
+        view.width = pixels.width;
+        view.height = pixels.height;
+        view.pitch = pixels.pitch;
+        view.buffer = static_cast<const char*>(pixels.buffer);
+        return true;
+    }
+
+    // Slices stored alike are meshed as stored, the others as floats of
+    // their actual values
+    void chooseVoxelType(const std::vector<DecodedSlice>& slices, VoxelType& type, Rescale& rescale) {
+        type = slices.front().type;
+        rescale = slices.front().rescale;
+
+        for (const DecodedSlice& slice : slices) {
+            if (slice.type != type || slice.rescale != rescale) {
+                type = VoxelType_Float32;
+                rescale = Rescale();
+                return;
+            }
+        }
+    }
+
+    // Maps ranges of actual values onto the ranges of stored values that
+    // hold them, keeping the index of every mapped range. The ranges that no
+    // stored value lies in are left out, their meshes being empty.
+    template <typename PixelType>
+    ValueRanges<PixelType> mapRanges(const std::vector<ThresholdRange>& ranges, const Rescale& rescale,
+                                     std::vector<size_t>& mapped) {
+        const double lowest = static_cast<double>(std::numeric_limits<PixelType>::lowest());
+        const double highest = static_cast<double>(std::numeric_limits<PixelType>::max());
+
+        ValueRanges<PixelType> target;
+        mapped.clear();
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            double lower = (ranges[i].lower - rescale.intercept) / rescale.slope;
+            double upper = (ranges[i].upper - rescale.intercept) / rescale.slope;
+            if (rescale.slope < 0) {
+                std::swap(lower, upper);
+            }
+
+            if (std::is_integral<PixelType>::value) {
+                lower = std::ceil(lower - RescaleTolerance);
+                upper = std::floor(upper + RescaleTolerance);
+            }
+
+            lower = std::max(lower, lowest);
+            upper = std::min(upper, highest);
+            if (!(lower <= upper)) {
+                continue;
+            }
+
+            target.push_back(std::make_pair(static_cast<PixelType>(lower), static_cast<PixelType>(upper)));
+            mapped.push_back(i);
+        }
+
+        return target;
+    }
+
+    // Puts the meshes of the mapped ranges back in the order of all the ranges
+    void distributeMeshes(std::vector<TriangleMesh>& meshes, const std::vector<size_t>& mapped, size_t count,
+                          std::vector<TriangleMesh>& targets) {
+        targets.clear();
+        targets.resize(count);
+        for (size_t i = 0; i < mapped.size(); ++i) {
+            targets[mapped[i]] = std::move(meshes[i]);
+        }
+    }
+
+    // Geometry of the volume that slices of this size and in-plane spacing
+    // make once laid out
+    void applyLayout(const SliceLayout& layout, unsigned int width, unsigned int height, const double spacing[2],
+                     VolumeGeometry& geometry) {
+        const double* rows = layout.cosines;
+        const double* columns = layout.cosines + 3;
+        const double normal[3] = {
+                rows[1] * columns[2] - rows[2] * columns[1],
+                rows[2] * columns[0] - rows[0] * columns[2],
+                rows[0] * columns[1] - rows[1] * columns[0]
+        };
+
+        geometry.size[0] = width;
+        geometry.size[1] = height;
+        geometry.size[2] = layout.count;
+
+        geometry.spacing[0] = spacing[0];
+        geometry.spacing[1] = spacing[1];
+        geometry.spacing[2] = layout.spacing > 0 ? layout.spacing : 1.0;
+
+        for (unsigned int i = 0; i < Dimension; ++i) {
+            geometry.origin[i] = layout.origin[i];
+            geometry.direction[3 * i] = rows[i];
+            geometry.direction[3 * i + 1] = columns[i];
+            geometry.direction[3 * i + 2] = normal[i];
+        }
+    }
+
+    // Sorts the slices along the normal of the first one, and computes the
+    // geometry of the volume they make
+    bool orderSlices(std::vector<DecodedSlice>& slices, VolumeGeometry& geometry) {
+        SliceLayout layout;
+        std::copy(slices.front().cosines, slices.front().cosines + 6, layout.cosines);
+        const double* rows = layout.cosines;
+        const double* columns = layout.cosines + 3;
+        const double normal[3] = {
+                rows[1] * columns[2] - rows[2] * columns[1],
+                rows[2] * columns[0] - rows[0] * columns[2],
+                rows[0] * columns[1] - rows[1] * columns[0]
+        };
+
+        for (DecodedSlice& slice : slices) {
+            slice.position = slice.origin[0] * normal[0] + slice.origin[1] * normal[1] + slice.origin[2] * normal[2];
+        }
+
+        std::sort(slices.begin(), slices.end(), [](const DecodedSlice& a, const DecodedSlice& b) {
+            return a.position < b.position;
+        });
+
+        const DecodedSlice& bottom = slices.front();
+        for (const DecodedSlice& slice : slices) {
+            if (slice.width != bottom.width || slice.height != bottom.height) {
+                std::cout << "All slices of a series must have the same size" << std::endl;
+                return false;
+            }
+        }
+
+        layout.count = slices.size();
+        std::copy(bottom.origin, bottom.origin + 3, layout.origin);
+        layout.spacing = slices.size() > 1 ? std::fabs(slices[1].position - slices[0].position) : 1.0;
+
+        applyLayout(layout, bottom.width, bottom.height, bottom.spacing, geometry);
+        return true;
+    }
+
+
+    template <typename PixelType>
+    typename ImageType<PixelType>::Pointer allocateImage(const VolumeGeometry& geometry) {
+        using Image = ImageType<PixelType>;
+        typename Image::SizeType size;
+        typename Image::SpacingType spacing;
+        typename Image::PointType origin;
+        typename Image::DirectionType direction;
+        for (unsigned int i = 0; i < Dimension; ++i) {
+            size[i] = geometry.size[i];
+            spacing[i] = geometry.spacing[i];
+            origin[i] = geometry.origin[i];
+            for (unsigned int j = 0; j < Dimension; ++j) {
+                direction[i][j] = geometry.direction[3 * i + j];
+            }
+        }
+
+        typename Image::RegionType region;
+        region.SetSize(size);
+
+        typename Image::Pointer image = Image::New();
+        image->SetRegions(region);
+        image->SetSpacing(spacing);
+        image->SetOrigin(origin);
+        image->SetDirection(direction);
+        image->Allocate();
+        return image;
+    }
+
+    template <typename PixelType>
+    VolumeGeometry getGeometry(const ImageType<PixelType>* image) {
+        VolumeGeometry geometry;
+        const typename ImageType<PixelType>::SizeType& size = image->GetLargestPossibleRegion().GetSize();
+        for (unsigned int i = 0; i < Dimension; ++i) {
+            geometry.size[i] = size[i];
+            geometry.spacing[i] = image->GetSpacing()[i];
+            geometry.origin[i] = image->GetOrigin()[i];
+            for (unsigned int j = 0; j < Dimension; ++j) {
+                geometry.direction[3 * i + j] = image->GetDirection()[i][j];
+            }
+        }
+        return geometry;
+    }
+
+    // Copies the output of the ITK filter into flat arrays, cell by cell, so
+    // that the ITK mesh can be released as soon as it has been converted.
+    // Unlike marching cubes, the filter may repeat the points of a cube.
+    void convertMesh(const MeshType* mesh, TriangleMesh& target) {
+        target.clear();
+
+        const MeshType::PointsContainer* points = mesh->GetPoints();
+        if (points != nullptr) {
+            target.points.resize(3 * points->Size());
+            for (auto point = points->Begin(); point != points->End(); ++point) {
+                const size_t index = point.Index();
+                if (3 * index + 2 >= target.points.size()) {
+                    target.points.resize(3 * index + 3);
+                }
+                const MeshType::PointType& p = point.Value();
+                target.points[3 * index] = p[0];
+                target.points[3 * index + 1] = p[1];
+                target.points[3 * index + 2] = p[2];
+            }
+        }
+
+        const MeshType::CellsContainer* cells = mesh->GetCells();
+        if (cells != nullptr) {
+            target.triangles.reserve(3 * cells->Size());
+            for (auto cell = cells->Begin(); cell != cells->End(); ++cell) {
+                const MeshType::CellType* c = cell.Value();
+                if (c->GetNumberOfPoints() < 3) {
+                    continue;
+                }
+
+                // Polygons other than triangles are split into fans
+                const MeshType::CellType::PointIdConstIterator ids = c->PointIdsBegin();
+                for (unsigned int i = 2; i < c->GetNumberOfPoints(); ++i) {
+                    target.triangles.push_back(static_cast<uint32_t>(ids[0]));
+                    target.triangles.push_back(static_cast<uint32_t>(ids[i - 1]));
+                    target.triangles.push_back(static_cast<uint32_t>(ids[i]));
+                }
+            }
+        }
+
+        weldPoints(target);
+    }
+
+
+    template <typename PixelType>
+    class TypedVolume : public DecodedVolume {
+    private:
+        typename ImageType<PixelType>::Pointer image;
+        Rescale rescale;
+        std::unique_ptr<BrickGrid<PixelType> > bricks;
+
+    public:
+        TypedVolume(typename ImageType<PixelType>::Pointer image, const Rescale& rescale) :
+                image(image), rescale(rescale) {}
+
+        size_t getMemoryFootprint() const override {
+            return image->GetPixelContainer()->Size() * sizeof(PixelType) +
+                   (bricks ? bricks->getMemoryFootprint() : 0);
+        }
+
+        void scanBricks(unsigned int threads) override {
+            bricks.reset(new BrickGrid<PixelType>(image->GetBufferPointer(), getGeometry<PixelType>(image).size,
+                                                  threads));
+        }
+
+        // The ITK filter only meshes a single stored value, marching cubes
+        // meshes the other cases in one scan of the volume
+        bool extractMeshes(MeshEngine engine, const std::vector<ThresholdRange>& ranges, unsigned int threads,
+                           std::vector<TriangleMesh>& targets) const override {
+            std::vector<size_t> mapped;
+            const ValueRanges<PixelType> values = mapRanges<PixelType>(ranges, rescale, mapped);
+
+            std::vector<TriangleMesh> meshes;
+            if (values.empty()) {
+                // No voxel can lie in any range
+            } else if (engine == MeshEngine_MarchingCubes ||
+                       values.size() != 1 ||
+                       values[0].first != values[0].second) {
+                try {
+                    const VolumeGeometry geometry = getGeometry<PixelType>(image);
+
+                    // Scanning the volume for its brick grid costs about as
+                    // much as meshing a single range, so only pays off with
+                    // several
+                    const BrickGrid<PixelType>* grid = bricks.get();
+                    std::unique_ptr<BrickGrid<PixelType> > scanned;
+                    if (grid == nullptr && values.size() > 1) {
+                        scanned.reset(new BrickGrid<PixelType>(image->GetBufferPointer(), geometry.size, threads));
+                        grid = scanned.get();
+                    }
+
+                    extractIsosurfaces<PixelType>(image->GetBufferPointer(), geometry, values, threads, meshes, grid);
+                } catch (std::exception& e) {
+                    std::cout << "Cannot mesh the volume: " << e.what() << std::endl;
+                    return false;
+                }
+            } else {
+                using FilterType = itk::BinaryMask3DMeshSource< ImageType<PixelType>, MeshType >;
+                typename FilterType::Pointer filter = FilterType::New();
+                filter->SetInput( image );
+                filter->SetObjectValue( values[0].first );
+
+                try {
+                    filter->Update();
+                } catch (itk::ExceptionObject &ex) {
+                    std::cout << ex << std::endl;
+                    return false;
+                }
+
+                meshes.resize(1);
+                convertMesh(filter->GetOutput(), meshes[0]);
+            }
+
+            distributeMeshes(meshes, mapped, ranges.size(), targets);
+            return true;
+        }
+
+        bool streamMesh(const ThresholdRange& range, unsigned int threads,
+                        const SlabCallback& callback) const override {
+            std::vector<size_t> mapped;
+            const ValueRanges<PixelType> values = mapRanges<PixelType>(std::vector<ThresholdRange>(1, range),
+                                                                       rescale, mapped);
+            if (values.empty()) {
+                return true;
+            }
+
+            try {
+                extractIsosurfaceSlabs<PixelType>(image->GetBufferPointer(), getGeometry<PixelType>(image),
+                                                  values[0].first, values[0].second, threads, callback,
+                                                  bricks.get());
+            } catch (std::exception& e) {
+                std::cout << "Cannot mesh the volume: " << e.what() << std::endl;
+                return false;
+            }
+
+            return true;
+        }
+    };
+
+    // Allocates a volume of this type, whose voxels the slices are then
+    // written into
+    template <typename PixelType>
+    std::unique_ptr<DecodedVolume> allocateVolume(const VolumeGeometry& geometry, const Rescale& rescale,
+                                                  char*& voxels) {
+        typename ImageType<PixelType>::Pointer image = allocateImage<PixelType>(geometry);
+        voxels = reinterpret_cast<char*>(image->GetBufferPointer());
+        return std::unique_ptr<DecodedVolume>(new TypedVolume<PixelType>(image, rescale));
+    }
+
+    template <typename PixelType>
+    std::unique_ptr<DecodedVolume> buildVolume(const std::vector<DecodedSlice>& slices, const VolumeGeometry& geometry,
+                                               const Rescale& rescale) {
+        typename ImageType<PixelType>::Pointer image = allocateImage<PixelType>(geometry);
+        PixelType* target = image->GetBufferPointer();
+        const size_t sliceSize = geometry.size[0] * geometry.size[1];
+        for (const DecodedSlice& slice : slices) {
+            storeRows(getView(slice), rescale, target);
+            target += sliceSize;
+        }
+
+        return std::unique_ptr<DecodedVolume>(new TypedVolume<PixelType>(image, rescale));
+    }
+
+    std::unique_ptr<DecodedVolume> assembleVolume(std::vector<DecodedSlice>& slices) {
+        VolumeGeometry geometry;
+        if (!orderSlices(slices, geometry)) {
+            return nullptr;
+        }
+
+        VoxelType type;
+        Rescale rescale;
+        chooseVoxelType(slices, type, rescale);
+
+        return dispatchVoxelType(type, [&](auto tag) {
+            return buildVolume<typename decltype(tag)::Type>(slices, geometry, rescale);
+        });
+    }
+
+    // Meshes the mapped ranges of a volume loaded slab by slab
+    template <typename PixelType>
+    void meshOutOfCore(const SliceLoader<PixelType>& loader, const VolumeGeometry& geometry, const Rescale& rescale,
+                       const std::vector<ThresholdRange>& ranges, unsigned int threads,
+                       std::vector<TriangleMesh>& targets) {
+        std::vector<size_t> mapped;
+        const ValueRanges<PixelType> values = mapRanges<PixelType>(ranges, rescale, mapped);
+
+        std::vector<TriangleMesh> meshes;
+        if (!values.empty()) {
+            extractIsosurfacesOutOfCore<PixelType>(loader, geometry, values, threads, meshes);
+        }
+
+        distributeMeshes(meshes, mapped, ranges.size(), targets);
+    }
+
+    // Meshes sorted slices with marching cubes, without copying them into
+    // an image first
+    bool meshSlices(const std::vector<DecodedSlice>& slices, const VolumeGeometry& geometry,
+                    const std::vector<ThresholdRange>& ranges, unsigned int threads,
+                    std::vector<TriangleMesh>& targets) {
+        VoxelType type;
+        Rescale rescale;
+        chooseVoxelType(slices, type, rescale);
+
+        const size_t sliceSize = geometry.size[0] * geometry.size[1];
+        try {
+            dispatchVoxelType(type, [&](auto tag) {
+                using PixelType = typename decltype(tag)::Type;
+                const SliceLoader<PixelType> loader = [&](PixelType* window, size_t first, size_t last) {
+                    for (size_t i = first; i < last; ++i) {
+                        storeRows(getView(slices[i]), rescale, window + (i - first) * sliceSize);
+                    }
+                };
+
+                meshOutOfCore<PixelType>(loader, geometry, rescale, ranges, threads, targets);
+            });
+        } catch (std::exception& e) {
+            std::cout << "Cannot mesh the volume: " << e.what() << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool readSlice(const std::string& fileName, DecodedSlice& slice) {
+        std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+        if (!file.is_open()) {
+            std::cout << "Cannot read " << fileName << std::endl;
+            return false;
+        }
+
+        const std::vector<char> content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        return decodeSlice(DicomBuffer(content.data(), content.size()), slice);
+    }
+
+
+    // Meshes a series that is sorted along its normal, as ITK sorts it or as
+    // laid out by the caller, reading each file only when the slab that
+    // holds it is meshed. The series is meshed in the type and rescale of its
+    // first slice, which every slice must share.
+    bool meshFiles(std::vector<std::string> fileNames, const SliceLayout* layout,
+                   const std::vector<ThresholdRange>& ranges, unsigned int threads,
+                   std::vector<TriangleMesh>& targets) {
+        VolumeGeometry geometry;
+        VoxelType type;
+        Rescale rescale;
+        if (layout != nullptr) {
+            // Only the in-plane geometry is left to read
+            DecodedSlice first;
+            if (!readSlice(fileNames[0], first)) {
+                return false;
+            }
+            applyLayout(*layout, first.width, first.height, first.spacing, geometry);
+            type = first.type;
+            rescale = first.rescale;
+        } else {
+            std::vector<DecodedSlice> ends(fileNames.size() > 1 ? 2 : 1);
+            for (size_t i = 0; i < ends.size(); ++i) {
+                if (!readSlice(fileNames[i], ends[i])) {
+                    return false;
+                }
+            }
+
+            const double firstOrigin[3] = {ends[0].origin[0], ends[0].origin[1], ends[0].origin[2]};
+            type = ends[0].type;
+            rescale = ends[0].rescale;
+
+            if (!orderSlices(ends, geometry)) {
+                return false;
+            }
+            geometry.size[2] = fileNames.size();
+
+            // The files may run against the normal
+            if (!std::equal(firstOrigin, firstOrigin + 3, ends[0].origin)) {
+                std::reverse(fileNames.begin(), fileNames.end());
+            }
+        }
+
+        const size_t sliceSize = geometry.size[0] * geometry.size[1];
+        try {
+            dispatchVoxelType(type, [&](auto tag) {
+                using PixelType = typename decltype(tag)::Type;
+                const SliceLoader<PixelType> loader = [&](PixelType* window, size_t first, size_t last) {
+                    for (size_t i = first; i < last; ++i) {
+                        DecodedSlice slice;
+                        if (!readSlice(fileNames[i], slice) ||
+                            slice.width != geometry.size[0] ||
+                            slice.height != geometry.size[1]) {
+                            throw std::runtime_error("Bad slice " + fileNames[i]);
+                        }
+                        if (slice.type != type || slice.rescale != rescale) {
+                            throw std::runtime_error("Slice " + fileNames[i] + " is stored unlike the first one, "
+                                                     "mesh the series in core");
+                        }
+                        std::memcpy(window + (i - first) * sliceSize, slice.pixels.data(),
+                                    sliceSize * sizeof(PixelType));
+                    }
+                };
+
+                meshOutOfCore<PixelType>(loader, geometry, rescale, ranges, threads, targets);
+            });
+        } catch (std::exception& e) {
+            std::cout << "Cannot mesh the series: " << e.what() << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    // Keeps the first slice of a laid out series, for its in-plane geometry
+    // and the type the series is meshed in
+    class FirstSliceSink : public SliceSink {
+    public:
+        DecodedSlice slice;
+        bool added;
+
+        FirstSliceSink() : added(false) {}
+
+        bool addInstance(const DicomBuffer& instance, size_t index) override {
+            added = (index == 0 && decodeSlice(instance, slice));
+            return added;
+        }
+
+        bool addSlice(const SlicePixels& pixels, size_t index) override {
+            SliceView view;
+            if (index != 0 || !getView(pixels, view)) {
+                return false;
+            }
+
+            slice = copySlice(view);
+            slice.spacing[0] = pixels.spacing[0];
+            slice.spacing[1] = pixels.spacing[1];
+            added = true;
+            return true;
+        }
+    };
+
+    // Writes the slices of one slab into its window, as long as they are
+    // stored like the first slice of the series
+    template <typename PixelType>
+    class SlabSink : public SliceSink {
+    private:
+        const VolumeGeometry& geometry;
+        const Rescale& rescale;
+        PixelType* window;
+        size_t first;
+        std::vector<char> placed;    // Rather than bits, as set from several threads
+
+    public:
+        SlabSink(const VolumeGeometry& geometry, const Rescale& rescale, PixelType* window, size_t first,
+                 size_t last) :
+                geometry(geometry), rescale(rescale), window(window), first(first), placed(last - first, 0) {}
+
+        bool place(const SliceView& view, size_t index) {
+            if (index < first || index >= first + placed.size()) {
+                std::cout << "No slice " << index << " in the slab being meshed" << std::endl;
+                return false;
+            }
+
+            if (view.width != geometry.size[0] || view.height != geometry.size[1]) {
+                std::cout << "All slices of a series must have the same size" << std::endl;
+                return false;
+            }
+
+            if (view.type != getVoxelType<PixelType>() || view.rescale != rescale) {
+                std::cout << "Slice " << index << " is stored unlike the first one, "
+                          << "mesh the series in core" << std::endl;
+                return false;
+            }
+
+            storeRows(view, rescale, window + (index - first) * geometry.size[0] * geometry.size[1]);
+            placed[index - first] = 1;
+            return true;
+        }
+
+        bool addInstance(const DicomBuffer& instance, size_t index) override {
+            DecodedSlice slice;
+            return decodeSlice(instance, slice) && place(getView(slice), index);
+        }
+
+        bool addSlice(const SlicePixels& pixels, size_t index) override {
+            SliceView view;
+            return getView(pixels, view) && place(view, index);
+        }
+
+        // Throws if the source left a slice of the slab out
+        void checkComplete() const {
+            for (size_t i = 0; i < placed.size(); ++i) {
+                if (!placed[i]) {
+                    throw std::runtime_error("Slice " + std::to_string(first + i) + " of the series is missing");
+                }
+            }
+        }
+    };
+
+    // Reads the first slice of a laid out series from the source, for its
+    // geometry and the type it is meshed in, then runs "use" with a loader
+    // that asks the source for the slices of each slab. The series is meshed
+    // in the type and rescale of its first slice, which every slice must
+    // share.
+    template <typename Use>
+    bool useSource(const SliceLayout& layout, const SliceSource& source, const Use& use) {
+        if (layout.count == 0) {
+            std::cout << "No DICOM instance to read" << std::endl;
+            return false;
+        }
+
+        std::cout << "Now meshing " << layout.count << " laid out slices slab by slab" << std::endl;
+
+        try {
+            FirstSliceSink firstSlice;
+            source(firstSlice, 0, 1);
+            if (!firstSlice.added) {
+                std::cout << "Cannot read the first slice of the series" << std::endl;
+                return false;
+            }
+
+            const DecodedSlice& head = firstSlice.slice;
+            VolumeGeometry geometry;
+            applyLayout(layout, head.width, head.height, head.spacing, geometry);
+
+            dispatchVoxelType(head.type, [&](auto tag) {
+                using PixelType = typename decltype(tag)::Type;
+                const SliceLoader<PixelType> loader = [&](PixelType* window, size_t first, size_t last) {
+                    SlabSink<PixelType> sink(geometry, head.rescale, window, first, last);
+                    source(sink, first, last);
+                    sink.checkComplete();
+                };
+
+                use(tag, loader, geometry, head.rescale);
+            });
+        } catch (std::exception& e) {
+            std::cout << "Cannot mesh the series: " << e.what() << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    // Meshes a laid out series slab by slab, asking the source for the
+    // slices of each slab right before meshing it
+    bool meshSource(const SliceLayout& layout, const SliceSource& source,
+                    const std::vector<ThresholdRange>& ranges, unsigned int threads,
+                    std::vector<TriangleMesh>& targets) {
+        return useSource(layout, source, [&](auto tag, const auto& loader, const VolumeGeometry& geometry,
+                                             const Rescale& rescale) {
+            meshOutOfCore<typename decltype(tag)::Type>(loader, geometry, rescale, ranges, threads, targets);
+        });
+    }
+
+    // Same as above, handing the surface of a single range over to the
+    // callback slab by slab, in order
+    bool streamSource(const SliceLayout& layout, const SliceSource& source, const ThresholdRange& range,
+                      unsigned int threads, const SlabCallback& callback) {
+        return useSource(layout, source, [&](auto tag, const auto& loader, const VolumeGeometry& geometry,
+                                             const Rescale& rescale) {
+            using PixelType = typename decltype(tag)::Type;
+            std::vector<size_t> mapped;
+            const ValueRanges<PixelType> values = mapRanges<PixelType>(std::vector<ThresholdRange>(1, range),
+                                                                       rescale, mapped);
+            if (!values.empty()) {
+                extractIsosurfaceSlabsOutOfCore<PixelType>(loader, geometry, values[0].first, values[0].second,
+                                                           threads, callback);
+            }
+        });
+    }
+
+    // Type that ITK reads the series in, from the header of one of its
+    // files. ITK applies the rescale itself, so its values are actual ones.
+    VoxelType getSeriesVoxelType(const std::string& fileName) {
+        itk::GDCMImageIO::Pointer dicomIO = itk::GDCMImageIO::New();
+        dicomIO->SetFileName( fileName );
+        dicomIO->ReadImageInformation();
+
+        switch (dicomIO->GetComponentType()) {
+            case itk::ImageIOBase::UCHAR:
+                return VoxelType_UInt8;
+            case itk::ImageIOBase::CHAR:
+            case itk::ImageIOBase::SHORT:
+                return VoxelType_Int16;
+            case itk::ImageIOBase::USHORT:
+                return VoxelType_UInt16;
+            default:
+                return VoxelType_Float32;
+        }
+    }
+
+    template <typename PixelType>
+    std::unique_ptr<DecodedVolume> readSeries(const std::vector<std::string>& fileNames) {
+        using ReaderType = itk::ImageSeriesReader< ImageType<PixelType> >;
+        typename ReaderType::Pointer reader = ReaderType::New();
+        reader->SetImageIO( itk::GDCMImageIO::New() );
+        reader->SetFileNames( fileNames );
+        reader->Update();
+
+        return std::unique_ptr<DecodedVolume>(new TypedVolume<PixelType>(reader->GetOutput(), Rescale()));
+    }
+
+    void simplifyMesh(TriangleMesh& mesh, size_t targetTriangles, double reduction, unsigned int threads) {
+        const size_t count = mesh.getTriangleCount();
+        if (targetTriangles == 0 && reduction > 0 && reduction < 1) {
+            targetTriangles = static_cast<size_t>(static_cast<double>(count) * (1.0 - reduction));
+        }
+
+        if (targetTriangles == 0 || targetTriangles >= count) {
+            return;
+        }
+
+        decimateMesh(mesh, targetTriangles, threads);
+        std::cout << "Decimated " << count << " triangles down to " << mesh.getTriangleCount() << std::endl;
+    }
+
+    bool endsWith(const std::string& value, const std::string& suffix) {
+        return value.size() >= suffix.size() &&
+               value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // Shortest decimal form of a threshold, "inf" when unbounded
+    std::string formatThreshold(double value) {
+        if (std::isinf(value)) {
+            return value < 0 ? "-inf" : "inf";
+        }
+
+        std::ostringstream s;
+        s << std::setprecision(10) << value;
+        return s.str();
+    }
+
+    // "mesh.vtk" becomes "mesh-4.vtk" for label 4, "mesh-100-300.vtk" for [100, 300]
+    std::string getRangeFileName(const std::string& fileName, const ThresholdRange& range) {
+        std::string suffix = "-" + formatThreshold(range.lower);
+        if (range.upper != range.lower) {
+            suffix += "-" + formatThreshold(range.upper);
+        }
+
+        const size_t dot = fileName.find_last_of('.');
+        const size_t slash = fileName.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return fileName + suffix;
+        }
+
+        return fileName.substr(0, dot) + suffix + fileName.substr(dot);
+    }
+
+    // The whole file is serialized in memory first, then written at once
+    bool writeMesh(const TriangleMesh& mesh, MeshFormat format, MeshPrecision precision, const std::string& fileName) {
+        if (endsWith(fileName, ".vtp")) {
+            format = MeshFormat_Vtp;
+        } else if (format == MeshFormat_Vtp) {
+            format = MeshFormat_VtkBinary;
+        }
+
+        std::string content;
+        serializeMesh(mesh, format, content, precision);
+
+        std::cout << "Using output filename:" << std::endl;
+        std::cout << fileName << std::endl;
+
+        std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary);
+        file.write(content.data(), static_cast<std::streamsize>(content.size()));
+        file.close();
+
+        if (!file) {
+            std::cout << "Cannot write " << fileName << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+}
+
+size_t getMemoryFootprint(const DecodedVolume& volume) {
+    return volume.getMemoryFootprint();
+}
+
+struct VtkGenerator::PendingSlices {
+    std::mutex mutex;
+    std::vector<DecodedSlice> slices;
+    std::unique_ptr<SliceLayout> layout;
+
+    // With a layout, the volume is allocated on the first slice, in the type
+    // and rescale of that slice, and every slice stored alike is written
+    // straight into its place. The others are kept aside until the volume
+    // is complete.
+    std::unique_ptr<DecodedVolume> placed;
+    VolumeGeometry geometry;
+    VoxelType type;
+    Rescale rescale;
+    char* voxels;
+    std::vector<bool> written;
+    std::vector<std::pair<size_t, DecodedSlice> > strays;
+
+    PendingSlices() : type(VoxelType_UInt16), voxels(nullptr) {}
+
+    bool add(DecodedSlice& slice) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (layout) {
+            std::cout << "The slices of a laid out series must be added with their index" << std::endl;
+            return false;
+        }
+
+        slices.push_back(std::move(slice));
+        return true;
+    }
+
+    size_t getSliceBytes() const {
+        return geometry.size[0] * geometry.size[1] * getVoxelSize(type);
+    }
+
+    bool place(const SliceView& view, const double spacing[2], size_t index) {
+        char* target;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!layout || index >= layout->count) {
+                std::cout << "No slice " << index << " in the layout of the series" << std::endl;
+                return false;
+            }
+
+            if (!placed) {
+                applyLayout(*layout, view.width, view.height, spacing, geometry);
+                type = view.type;
+                rescale = view.rescale;
+                placed = dispatchVoxelType(type, [&](auto tag) {
+                    return allocateVolume<typename decltype(tag)::Type>(geometry, rescale, voxels);
+                });
+                written.assign(layout->count, false);
+            }
+
+            if (view.width != geometry.size[0] || view.height != geometry.size[1]) {
+                std::cout << "All slices of a series must have the same size" << std::endl;
+                return false;
+            }
+
+            if (written[index]) {
+                std::cout << "Slice " << index << " of the series was added twice" << std::endl;
+                return false;
+            }
+
+            written[index] = true;
+
+            if (view.type != type || view.rescale != rescale) {
+                strays.push_back(std::make_pair(index, copySlice(view)));
+                return true;
+            }
+
+            target = voxels + index * getSliceBytes();
+        }
+
+        // Every slice has a place of its own, so they are copied outside the lock
+        dispatchVoxelType(type, [&](auto tag) {
+            using PixelType = typename decltype(tag)::Type;
+            storeRows(view, rescale, reinterpret_cast<PixelType*>(target));
+        });
+        return true;
+    }
+
+    bool place(const SlicePixels& pixels, size_t index) {
+        SliceView view;
+        return getView(pixels, view) && place(view, pixels.spacing, index);
+    }
+
+    bool place(const DecodedSlice& slice, size_t index) {
+        return place(getView(slice), slice.spacing, index);
+    }
+
+    // Hands over the slices collected so far, and forgets them
+    bool takeSlices(std::vector<DecodedSlice>& target) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            target.swap(slices);
+            slices.clear();
+        }
+
+        if (target.empty()) {
+            std::cout << "No DICOM instance to read" << std::endl;
+            return false;
+        }
+
+        std::cout << "Now reading " << target.size() << " in-memory slices" << std::endl;
+        return true;
+    }
+
+    // Rewrites the placed slices and the strays into a volume of floats of
+    // their actual values
+    std::unique_ptr<DecodedVolume> convertPlacedVolume() {
+        std::vector<const DecodedSlice*> stored(written.size(), nullptr);
+        for (const std::pair<size_t, DecodedSlice>& stray : strays) {
+            stored[stray.first] = &stray.second;
+        }
+
+        ImageType<float>::Pointer image = allocateImage<float>(geometry);
+        const size_t sliceSize = geometry.size[0] * geometry.size[1];
+        for (size_t i = 0; i < stored.size(); ++i) {
+            SliceView view;
+            if (stored[i] != nullptr) {
+                view = getView(*stored[i]);
+            } else {
+                view.type = type;
+                view.rescale = rescale;
+                view.width = static_cast<unsigned int>(geometry.size[0]);
+                view.height = static_cast<unsigned int>(geometry.size[1]);
+                view.pitch = geometry.size[0] * getVoxelSize(type);
+                view.buffer = voxels + i * getSliceBytes();
+            }
+            storeRows(view, Rescale(), image->GetBufferPointer() + i * sliceSize);
+        }
+
+        return std::unique_ptr<DecodedVolume>(new TypedVolume<float>(image, Rescale()));
+    }
+
+    // Hands over the volume the laid out slices were written into, once
+    // they all were, and forgets it
+    std::unique_ptr<DecodedVolume> takePlacedVolume() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!placed) {
+            std::cout << "No DICOM instance to read" << std::endl;
+            return nullptr;
+        }
+
+        for (size_t i = 0; i < written.size(); ++i) {
+            if (!written[i]) {
+                std::cout << "Slice " << i << " of the series is missing" << std::endl;
+                return nullptr;
+            }
+        }
+
+        std::cout << "Now reading " << written.size() << " laid out slices" << std::endl;
+
+        std::unique_ptr<DecodedVolume> taken;
+        if (strays.empty()) {
+            taken = std::move(placed);
+        } else {
+            std::cout << strays.size() << " slices are stored unlike the first one, "
+                      << "meshing the series in floats" << std::endl;
+            taken = convertPlacedVolume();
+        }
+
+        placed.reset();
+        voxels = nullptr;
+        written.clear();
+        strays.clear();
+        return taken;
+    }
+
+    // Builds the volume out of the slices collected so far, and forgets them
+    std::unique_ptr<DecodedVolume> takeVolume() {
+        if (layout) {
+            return takePlacedVolume();
+        }
+
+        std::vector<DecodedSlice> taken;
+        if (!takeSlices(taken)) {
+            return nullptr;
+        }
+
+        return assembleVolume(taken);
+    }
+};
+
+VtkGenerator::VtkGenerator() : directory(nullptr), outputFile(nullptr), pending(new PendingSlices),
+                               engine(MeshEngine_MarchingCubes), threads(0), format(MeshFormat_VtkBinary),
+                               precision(MeshPrecision_Float32), targetTriangles(0), reduction(0), outOfCore(false), ranges(1, ThresholdRange{255, 255}) {}
+
+VtkGenerator::VtkGenerator(const char* directory, const char* outputfile)  : directory(std::move(directory)), outputFile(std::move(outputfile)), pending(new PendingSlices),
+                                                                             engine(MeshEngine_MarchingCubes), threads(0), format(MeshFormat_VtkBinary),
+                                                                             precision(MeshPrecision_Float32), targetTriangles(0), reduction(0), outOfCore(false), ranges(1, ThresholdRange{255, 255}) {}
 
 VtkGenerator::~VtkGenerator() {
     directory = nullptr;
     outputFile = nullptr;
 }
 
-bool VtkGenerator::generate() {
-    using PixelType = unsigned short;
-    constexpr unsigned int Dimension = 3;
-    using ImageType = itk::Image< PixelType, Dimension >;
+void VtkGenerator::setEngine(MeshEngine engine) {
+    this->engine = engine;
+}
 
-    using ReaderType = itk::ImageSeriesReader< ImageType >;
-    ReaderType::Pointer reader = ReaderType::New();
+void VtkGenerator::setThreads(unsigned int threads) {
+    this->threads = threads;
+}
 
-    using ImageIOType = itk::GDCMImageIO;
-    ImageIOType::Pointer dicomIO = ImageIOType::New();
-    reader->SetImageIO( dicomIO );
+void VtkGenerator::setFormat(MeshFormat format) {
+    this->format = format;
+}
+
+void VtkGenerator::setPrecision(MeshPrecision precision) {
+    this->precision = precision;
+}
+
+void VtkGenerator::setTargetTriangles(size_t targetTriangles) {
+    this->targetTriangles = targetTriangles;
+}
+
+void VtkGenerator::setReduction(double reduction) {
+    this->reduction = reduction;
+}
+
+void VtkGenerator::setOutOfCore(bool outOfCore) {
+    this->outOfCore = outOfCore;
+}
+
+void VtkGenerator::setThresholds(const std::vector<ThresholdRange>& ranges) {
+    this->ranges = ranges;
+}
 
+void VtkGenerator::setLabels(const std::vector<unsigned short>& labels) {
+    ranges.clear();
+    for (unsigned short label : labels) {
+        ranges.push_back(ThresholdRange{static_cast<double>(label), static_cast<double>(label)});
+    }
+}
+
+bool VtkGenerator::generate() {
     using NamesGeneratorType = itk::GDCMSeriesFileNames;
     NamesGeneratorType::Pointer nameGenerator = NamesGeneratorType::New();
     nameGenerator->SetUseSeriesDetails( true );
@@ -68,40 +1420,312 @@ bool VtkGenerator::generate() {
         std::cout << std::endl;
     }
 
-    reader->SetFileNames( fileNames );
+    if (fileNames.empty()) {
+        std::cout << "No DICOM file to read" << std::endl;
+        return false;
+    }
 
-    try {
-        reader->Update();
-    } catch (itk::ExceptionObject &ex) {
-        std::cout << ex << std::endl;
+    if (ranges.empty()) {
+        std::cout << "No threshold range to mesh" << std::endl;
         return false;
     }
 
-    using MeshType = itk::Mesh< double, Dimension >;
-    using WriterType = itk::MeshFileWriter< MeshType >;
+    std::vector<TriangleMesh> meshes;
+    if (outOfCore) {
+        if (!meshFiles(fileNames, nullptr, ranges, threads, meshes)) {
+            return false;
+        }
+    } else {
+        // The series is read in the type of its values
+        std::unique_ptr<DecodedVolume> series;
+        try {
+            series = dispatchVoxelType(getSeriesVoxelType(fileNames[0]), [&](auto tag) {
+                return readSeries<typename decltype(tag)::Type>(fileNames);
+            });
+        } catch (itk::ExceptionObject &ex) {
+            std::cout << ex << std::endl;
+            return false;
+        }
 
-    using FilterType = itk::BinaryMask3DMeshSource< ImageType, MeshType >;
-    FilterType::Pointer filter = FilterType::New();
-    filter->SetInput( reader->GetOutput() );
-    filter->SetObjectValue( 255 );
+        if (!series->extractMeshes(engine, ranges, threads, meshes)) {
+            return false;
+        }
+    }
 
-    WriterType::Pointer writer = WriterType::New();
-    char * res = new char();
-    strcpy(res, directory);
-    strcat(res, outputFile);
+    return writeMeshes(meshes);
+}
 
-    std::cout << "Using output filename:" << std::endl;
-    std::cout << res << std::endl;
+bool VtkGenerator::generate(const std::vector<std::string>& fileNames, const SliceLayout& layout) {
+    if (fileNames.empty() || fileNames.size() != layout.count) {
+        std::cout << "The layout of the series does not match its " << fileNames.size() << " files" << std::endl;
+        return false;
+    }
 
-    writer->SetFileName( res );
-    writer->SetInput( filter->GetOutput() );
+    if (ranges.empty()) {
+        std::cout << "No threshold range to mesh" << std::endl;
+        return false;
+    }
+
+    std::cout << "Now reading " << fileNames.size() << " laid out files" << std::endl;
+
+    std::vector<TriangleMesh> meshes;
+    if (outOfCore) {
+        if (!meshFiles(fileNames, &layout, ranges, threads, meshes)) {
+            return false;
+        }
+    } else {
+        setLayout(layout);
+        for (size_t i = 0; i < fileNames.size(); ++i) {
+            DecodedSlice slice;
+            if (!readSlice(fileNames[i], slice) ||
+                !pending->place(slice, i)) {
+                return false;
+            }
+        }
+
+        std::unique_ptr<DecodedVolume> series = pending->takeVolume();
+        if (!series ||
+            !series->extractMeshes(engine, ranges, threads, meshes)) {
+            return false;
+        }
+    }
 
-    try {
-        writer->Update();
-    } catch (itk::ExceptionObject &ex) {
-        std::cout << ex << std::endl;
+    return writeMeshes(meshes);
+}
+
+bool VtkGenerator::writeMeshes(std::vector<TriangleMesh>& meshes) {
+    // One file per range, when there are several
+    const std::string fileName = std::string(directory) + outputFile;
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        simplifyMesh(meshes[i], targetTriangles, reduction, threads);
+        optimizeVertexOrder(meshes[i]);
+
+        if (!writeMesh(meshes[i], format, precision, meshes.size() == 1 ? fileName : getRangeFileName(fileName, ranges[i]))) {
+            return false;
+        }
+        meshes[i].clear();
+    }
+
+    return true;
+}
+
+bool VtkGenerator::generate(const std::vector<DicomBuffer>& instances, std::string& target) {
+    for (const DicomBuffer& instance : instances) {
+        if (!addInstance(instance)) {
+            return false;
+        }
+    }
+
+    return generateFromInstances(target);
+}
+
+bool VtkGenerator::addInstance(const DicomBuffer& instance) {
+    DecodedSlice slice;
+    return decodeSlice(instance, slice) && pending->add(slice);
+}
+
+void VtkGenerator::setLayout(const SliceLayout& layout) {
+    std::lock_guard<std::mutex> lock(pending->mutex);
+    pending->layout.reset(new SliceLayout(layout));
+    pending->slices.clear();
+    pending->placed.reset();
+    pending->voxels = nullptr;
+    pending->written.clear();
+    pending->strays.clear();
+}
+
+bool VtkGenerator::addInstance(const DicomBuffer& instance, size_t slice) {
+    DecodedSlice decoded;
+    return decodeSlice(instance, decoded) && pending->place(decoded, slice);
+}
+
+bool VtkGenerator::addSlice(const SlicePixels& pixels, size_t slice) {
+    return pending->place(pixels, slice);
+}
+
+void VtkGenerator::setSliceSource(const SliceLayout& layout, const SliceSource& source) {
+    sourceLayout.reset(new SliceLayout(layout));
+    this->source = source;
+}
+
+void VtkGenerator::takeSourceSlices() {
+    if (source) {
+        setLayout(*sourceLayout);
+        source(*this, 0, sourceLayout->count);
+        source = nullptr;
+    }
+}
+
+bool VtkGenerator::generateFromInstances(std::string& target) {
+    TriangleMesh mesh;
+    if (!generateFromInstances(mesh)) {
+        return false;
+    }
+
+    serializeMesh(mesh, format, target, precision);
+    return true;
+}
+
+bool VtkGenerator::generateFromInstances(TriangleMesh& target) {
+    if (ranges.size() != 1) {
+        std::cout << "Meshing " << ranges.size() << " threshold ranges needs one target per range" << std::endl;
+        return false;
+    }
+
+    std::vector<TriangleMesh> targets;
+    if (!generateFromInstances(targets)) {
         return false;
     }
 
+    target = std::move(targets[0]);
     return true;
-}
\ No newline at end of file
+}
+
+bool VtkGenerator::generateFromInstances(std::vector<std::string>& targets) {
+    std::vector<TriangleMesh> meshes;
+    if (!generateFromInstances(meshes)) {
+        return false;
+    }
+
+    targets.resize(meshes.size());
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        serializeMesh(meshes[i], format, targets[i], precision);
+        meshes[i].clear();
+    }
+
+    return true;
+}
+
+DecodedVolumePointer VtkGenerator::takeVolume() {
+    if (!volume) {
+        takeSourceSlices();
+        std::unique_ptr<DecodedVolume> taken = pending->takeVolume();
+        if (!taken) {
+            return nullptr;
+        }
+
+        try {
+            taken->scanBricks(threads);
+        } catch (std::exception& e) {
+            std::cout << "Cannot scan the volume: " << e.what() << std::endl;
+            return nullptr;
+        }
+        volume = std::move(taken);
+    }
+
+    return volume;
+}
+
+void VtkGenerator::setVolume(const DecodedVolumePointer& volume) {
+    this->volume = volume;
+}
+
+bool VtkGenerator::generateFromInstances(std::vector<TriangleMesh>& targets) {
+    if (ranges.empty()) {
+        std::cout << "No threshold range to mesh" << std::endl;
+        return false;
+    }
+
+    if (volume) {
+        if (!volume->extractMeshes(engine, ranges, threads, targets)) {
+            return false;
+        }
+    } else if (outOfCore && source) {
+        if (!meshSource(*sourceLayout, source, ranges, threads, targets)) {
+            return false;
+        }
+    } else if (outOfCore && !pending->layout) {
+        std::vector<DecodedSlice> slices;
+        VolumeGeometry geometry;
+        if (!pending->takeSlices(slices) ||
+            !orderSlices(slices, geometry) ||
+            !meshSlices(slices, geometry, ranges, threads, targets)) {
+            return false;
+        }
+    } else {
+        takeSourceSlices();
+        std::unique_ptr<DecodedVolume> series = pending->takeVolume();
+        if (!series) {
+            return false;
+        }
+
+        // Laid out slices are already in a volume, which out-of-core meshing
+        // would only copy again
+        if (!series->extractMeshes(outOfCore ? MeshEngine_MarchingCubes : engine, ranges, threads, targets)) {
+            return false;
+        }
+    }
+
+    for (TriangleMesh& target : targets) {
+        simplifyMesh(target, targetTriangles, reduction, threads);
+        optimizeVertexOrder(target);
+    }
+
+    return true;
+}
+
+bool VtkGenerator::generateLevelsFromInstances(std::vector<std::string>& targets, unsigned int count) {
+    TriangleMesh mesh;
+    if (!generateFromInstances(mesh)) {
+        return false;
+    }
+
+    std::vector<TriangleMesh> levels;
+    decimateLevels(levels, mesh, count, LevelRatio, threads);
+    mesh.clear();
+
+    targets.resize(levels.size());
+    for (size_t i = 0; i < levels.size(); ++i) {
+        // Level 0 is a copy of the mesh, which is already ordered
+        if (i > 0) {
+            optimizeVertexOrder(levels[i]);
+        }
+
+        std::cout << "Level of detail " << i << ": " << levels[i].getTriangleCount() << " triangles" << std::endl;
+        serializeMesh(levels[i], format, targets[i], precision);
+        levels[i].clear();
+    }
+
+    return true;
+}
+
+bool VtkGenerator::streamFromInstances(const std::function<void(const std::string&)>& callback) {
+    if (ranges.size() != 1) {
+        std::cout << "Only a single threshold range can be streamed" << std::endl;
+        return false;
+    }
+
+    size_t count = 0;
+    const SlabCallback send = [&](TriangleMesh& slab) {
+        optimizeVertexOrder(slab);
+
+        std::string content;
+        serializeMesh(slab, format, content, precision);
+        slab.clear();
+
+        callback(content);
+        count++;
+    };
+
+    if (!volume && outOfCore && source) {
+        if (!streamSource(*sourceLayout, source, ranges[0], threads, send)) {
+            return false;
+        }
+    } else if (!volume && outOfCore) {
+        std::cout << "Streaming out of core needs a slice source, the series would be decoded whole" << std::endl;
+        return false;
+    } else {
+        DecodedVolumePointer series = volume;
+        if (!series) {
+            takeSourceSlices();
+            series = pending->takeVolume();
+        }
+        if (!series ||
+            !series->streamMesh(ranges[0], threads, send)) {
+            return false;
+        }
+    }
+
+    std::cout << "Streamed the mesh in " << count << " slabs" << std::endl;
+    return true;
+}
@@ -1,22 +1,251 @@
 #ifndef DICOMITKLIBRARY_LIBRARY_H
 #define DICOMITKLIBRARY_LIBRARY_H
 
+#include <cstddef>
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
+#include "MeshWriters.h"
+#include "TriangleMesh.h"
 
 using byte = unsigned char;
 
-class VtkGenerator {
+// A DICOM instance held in memory. The owner, if any, keeps the storage alive
+// for as long as the generator references it, so callers can hand over their
+// buffers instead of copying them.
+struct DicomBuffer {
+    const void* data;
+    size_t size;
+    std::shared_ptr<void> owner;
+
+    DicomBuffer() : data(nullptr), size(0) {}
+
+    DicomBuffer(const void* data, size_t size, std::shared_ptr<void> owner = nullptr) :
+            data(data), size(size), owner(std::move(owner)) {}
+};
+
+// Inclusive range of voxel values once rescaled, such as Hounsfield units,
+// meshed as one surface. Either bound may be infinite.
+struct ThresholdRange {
+    double lower;
+    double upper;
+};
+
+// Order and geometry of the slices of a series, worked out by the caller
+// from tags it has already indexed, so that the generator neither scans nor
+// sorts them. The in-plane size and spacing are still read from the pixel
+// data.
+struct SliceLayout {
+    size_t count;        // Slices in the series
+    double origin[3];    // Position of the first slice
+    double cosines[6];   // Directions of the rows then of the columns
+    double spacing;      // Distance between two consecutive slices
+};
+
+enum SliceFormat {
+    SliceFormat_UInt8,
+    SliceFormat_UInt16,
+    SliceFormat_Int16
+};
+
+// A slice decoded by the caller, whose stored values mean
+// value * slope + intercept
+struct SlicePixels {
+    SliceFormat format;
+    unsigned int width;
+    unsigned int height;
+    size_t pitch;         // Bytes from one row to the next
+    const void* buffer;
+    double spacing[2];    // Between columns, then between rows
+    double slope;
+    double intercept;
+};
+
+// Receives the slices of a laid out series along with their index, from
+// several threads at once
+class SliceSink {
+public:
+    virtual ~SliceSink() {}
+
+    virtual bool addInstance(const DicomBuffer& instance, size_t slice) = 0;
+
+    virtual bool addSlice(const SlicePixels& pixels, size_t slice) = 0;
+};
+
+// Hands the slices [first, last) of a laid out series over to the sink. It
+// may be called from several threads at once, and may throw to stop the
+// meshing.
+typedef std::function<void(SliceSink& sink, size_t first, size_t last)> SliceSource;
+
+// A volume assembled from in-memory instances, along with its brick grid.
+// Its voxels keep the type they are stored in, 8 or 16 bits, unless its
+// slices are stored differently. It is never modified once built, so that
+// several generators may mesh it at once, at any threshold.
+class DecodedVolume;
+
+typedef std::shared_ptr<const DecodedVolume> DecodedVolumePointer;
+
+// Bytes held by the voxels and the brick grid of the volume
+size_t getMemoryFootprint(const DecodedVolume& volume);
+
+// The "BinaryMask" engine builds an itk::Mesh, with its cells and point
+// containers, before the mesh is converted, so its peak memory is several
+// times the size of the mesh itself. Marching cubes writes the mesh
+// straight into its output.
+enum MeshEngine {
+    MeshEngine_BinaryMask,       // itk::BinaryMask3DMeshSource, single-threaded
+    MeshEngine_MarchingCubes     // Parallel marching cubes over Z-slabs
+};
+
+class VtkGenerator : public SliceSink {
 private:
+    struct PendingSlices;
+
     const char* directory;
     const char* outputFile;
+    std::unique_ptr<PendingSlices> pending;
+    MeshEngine engine;
+    unsigned int threads;
+    MeshFormat format;
+    MeshPrecision precision;
+    size_t targetTriangles;
+    double reduction;
+    bool outOfCore;
+    std::vector<ThresholdRange> ranges;
+    DecodedVolumePointer volume;
+    std::unique_ptr<SliceLayout> sourceLayout;
+    SliceSource source;
+
+    bool writeMeshes(std::vector<TriangleMesh>& meshes);
+
+    // Asks the source for every slice at once, into the pending volume
+    void takeSourceSlices();
 
 public:
+    // Generator for in-memory instances, whose mesh is written to a buffer.
+    VtkGenerator();
+
     VtkGenerator(const char* directory, const char* outputfile);
 
     virtual ~VtkGenerator();
 
+    // Marching cubes by default.
+    void setEngine(MeshEngine engine);
+
+    // Threads used by the marching cubes engine and the decimation, 0 meaning
+    // one per core.
+    void setThreads(unsigned int threads);
+
+    // Output format of generate() and generateFromInstances(std::string&),
+    // binary legacy VTK by default. generate() always writes ".vtp" output
+    // files as VTK XML.
+    void setFormat(MeshFormat format);
+
+    // Precision of the positions in the output, 32-bit floats by default.
+    // Quantized positions only apply to glTF.
+    void setPrecision(MeshPrecision precision);
+
+    // Decimates the mesh down to at most this many triangles, 0 (the default)
+    // keeping the mesh as extracted. Takes precedence over setReduction().
+    void setTargetTriangles(size_t targetTriangles);
+
+    // Decimates the mesh by removing this fraction of its triangles, in
+    // [0, 1), 0 (the default) keeping the mesh as extracted.
+    void setReduction(double reduction);
+
+    // Meshes with marching cubes slab by slab, never building the whole
+    // volume: generate() reads the files of each slab when meshing it, a
+    // slice source is asked for the slices of each slab, and the in-memory
+    // instances are meshed in place, without the copy into an ITK image.
+    // Off by default; the engine setting is then ignored. Laid out instances
+    // go straight into the volume whatever this setting. Streaming out of
+    // core only works from a slice source, and fails otherwise rather than
+    // decoding the whole series.
+    void setOutOfCore(bool outOfCore);
+
+    // Ranges of voxel values to mesh, each into a mesh of its own, [255, 255]
+    // by default as in binary masks. The ranges are mapped onto the stored
+    // values of the series through its rescale, rather than every voxel
+    // being rescaled. Marching cubes meshes all the ranges in a single scan
+    // of the volume; the "BinaryMask" engine only meshes a single stored
+    // value, and falls back on marching cubes otherwise.
+    void setThresholds(const std::vector<ThresholdRange>& ranges);
+
+    // Same as above, with one range per label of a segmentation.
+    void setLabels(const std::vector<unsigned short>& labels);
+
+    // Scans the directory for a DICOM series and meshes it into the output
+    // file, or into one file per range suffixed with the range when there are
+    // several ("mesh-4.vtk", "mesh-100-300.vtk").
     bool generate();
 
+    // Same as above, meshing these files in this order instead of scanning
+    // the directory.
+    bool generate(const std::vector<std::string>& fileNames, const SliceLayout& layout);
+
+    // Builds the volume straight from in-memory instances, in any order, and
+    // serializes the mesh into the target buffer.
+    bool generate(const std::vector<DicomBuffer>& instances, std::string& target);
+
+    // Decodes one instance right away and keeps its slice for
+    // generateFromInstances(). Safe to call from several threads at once.
+    bool addInstance(const DicomBuffer& instance);
+
+    // Lays the slices out as the caller ordered them. They must then be
+    // added with their index in that order: the volume is allocated once,
+    // on the first slice, and every slice is written straight into it.
+    void setLayout(const SliceLayout& layout);
+
+    bool addInstance(const DicomBuffer& instance, size_t slice) override;
+
+    // Same as above, for a slice the caller has decoded itself. Safe to call
+    // from several threads at once.
+    bool addSlice(const SlicePixels& pixels, size_t slice) override;
+
+    // Leaves the slices of a laid out series to the source, which is only
+    // asked for them when meshing, instead of adding them beforehand. Out of
+    // core, every slab asks for its own slices right before being meshed, so
+    // that the instances of the series are never all held at once; otherwise
+    // the source is asked for every slice, into the volume.
+    void setSliceSource(const SliceLayout& layout, const SliceSource& source);
+
+    // Builds the volume out of the slices collected so far by addInstance(),
+    // and scans it for its brick grid, so that it can be kept and meshed
+    // again later on. The generator meshes that volume from then on. Returns
+    // null on failure.
+    DecodedVolumePointer takeVolume();
+
+    // Meshes this volume instead of the instances in the calls below, with
+    // whatever engine and out-of-core setting.
+    void setVolume(const DecodedVolumePointer& volume);
+
+    // Meshes the slices collected so far by addInstance() into the target
+    // buffer. Like every mesh the generator outputs, its triangles and
+    // points are ordered for the vertex cache of the GPU.
+    bool generateFromInstances(std::string& target);
+
+    // Same as above, leaving the serialization of the mesh to the caller.
+    bool generateFromInstances(TriangleMesh& target);
+
+    // Meshes every threshold range at once, one target per range in their
+    // order. The overloads above and below only accept a single range.
+    bool generateFromInstances(std::vector<std::string>& targets);
+
+    bool generateFromInstances(std::vector<TriangleMesh>& targets);
+
+    // Meshes the slices like generateFromInstances(), then serializes
+    // "count" levels of detail into the targets, from the full mesh down,
+    // every level having a quarter of the triangles of the previous one.
+    bool generateLevelsFromInstances(std::vector<std::string>& targets, unsigned int count);
+
+    // Meshes the slices with marching cubes, Z-slab by Z-slab, and hands
+    // every slab to the callback as soon as it is meshed, serialized on its
+    // own in the output format. The engine and the decimation settings are
+    // ignored. The callback may throw to stop the meshing. Out of core, the
+    // slices must come from a slice source, each slab asking for its own.
+    bool streamFromInstances(const std::function<void(const std::string&)>& callback);
+
 };
 
-#endif
\ No newline at end of file
+#endif
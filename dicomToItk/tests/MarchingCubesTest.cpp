@@ -0,0 +1,120 @@
+// Checks that marching cubes gives closed manifold surfaces: with the
+// voxels outside of the volume counting as background, every edge of the
+// mesh must be shared by exactly two triangles, with opposite directions.
+// Also checks that out-of-core streaming matches streaming from memory.
+
+#include "../MarchingCubes.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    // Number of edges that do not have exactly one triangle on each side
+    size_t countNonManifoldEdges(const TriangleMesh& mesh) {
+        std::map<std::pair<uint32_t, uint32_t>, int> edges;    // +1 per direction a -> b with a < b, -1 otherwise
+        std::map<std::pair<uint32_t, uint32_t>, int> uses;
+
+        for (size_t t = 0; t < mesh.getTriangleCount(); ++t) {
+            for (size_t k = 0; k < 3; ++k) {
+                const uint32_t a = mesh.triangles[3 * t + k];
+                const uint32_t b = mesh.triangles[3 * t + (k + 1) % 3];
+                const std::pair<uint32_t, uint32_t> key(std::min(a, b), std::max(a, b));
+                edges[key] += (a < b ? 1 : -1);
+                uses[key]++;
+            }
+        }
+
+        size_t count = 0;
+        for (const auto& edge : uses) {
+            if (edge.second != 2 || edges[edge.first] != 0) {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    VolumeGeometry getGeometry(size_t x, size_t y, size_t z) {
+        VolumeGeometry geometry = {{x, y, z}, {1, 1, 1}, {0, 0, 0}, {1, 0, 0, 0, 1, 0, 0, 0, 1}};
+        return geometry;
+    }
+
+    bool checkVolume(const std::vector<uint8_t>& voxels, const VolumeGeometry& geometry, const char* name) {
+        TriangleMesh mesh;
+        extractIsosurface<uint8_t>(voxels.data(), geometry, 1, 1, 1, mesh);
+
+        std::vector<TriangleMesh> meshes;
+        extractIsosurfaces<uint8_t>(voxels.data(), geometry, ValueRanges<uint8_t>(2, std::make_pair(1, 1)),
+                                    2, meshes);
+
+        const size_t single = countNonManifoldEdges(mesh);
+        const size_t scanned = countNonManifoldEdges(meshes[1]);
+        if (single != 0 || scanned != 0) {
+            std::cout << name << ": " << single << " and " << scanned << " non-manifold edges" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Streaming a volume loaded slab by slab must hand over the same slabs
+    // as streaming it from memory
+    bool checkStreaming(const std::vector<uint8_t>& voxels, const VolumeGeometry& geometry, const char* name) {
+        std::vector<TriangleMesh> inCore;
+        extractIsosurfaceSlabs<uint8_t>(voxels.data(), geometry, 1, 1, 2,
+                                        [&](TriangleMesh& slab) { inCore.push_back(slab); });
+
+        const size_t sliceSize = geometry.size[0] * geometry.size[1];
+        const SliceLoader<uint8_t> loader = [&](uint8_t* window, size_t first, size_t last) {
+            std::copy(voxels.begin() + first * sliceSize, voxels.begin() + last * sliceSize, window);
+        };
+
+        std::vector<TriangleMesh> outOfCore;
+        extractIsosurfaceSlabsOutOfCore<uint8_t>(loader, geometry, 1, 1, 2,
+                                                 [&](TriangleMesh& slab) { outOfCore.push_back(slab); });
+
+        bool same = (inCore.size() == outOfCore.size());
+        for (size_t i = 0; same && i < inCore.size(); ++i) {
+            same = (inCore[i].points == outOfCore[i].points && inCore[i].triangles == outOfCore[i].triangles);
+        }
+
+        if (!same) {
+            std::cout << name << ": the slabs streamed out of core differ" << std::endl;
+        }
+        return same;
+    }
+}
+
+int main() {
+    bool success = true;
+
+    // A loop that crosses the ambiguous face between two cubes twice
+    const uint8_t layers[] = {1, 1, 1, 1, 1, 1,
+                              0, 1, 1, 0, 0, 0,
+                              0, 1, 1, 1, 0, 0};
+    success &= checkVolume(std::vector<uint8_t>(layers, layers + sizeof(layers)), getGeometry(2, 3, 3),
+                           "Double ambiguous face");
+
+    std::mt19937 random(42);
+    for (unsigned int i = 0; i < 200; ++i) {
+        const size_t x = 2 + random() % 12;
+        const size_t y = 2 + random() % 12;
+        const size_t z = 2 + random() % 40;
+        const unsigned int density = random() % 100;
+
+        std::vector<uint8_t> voxels(x * y * z);
+        for (uint8_t& voxel : voxels) {
+            voxel = (random() % 100 < density ? 1 : 0);
+        }
+
+        success &= checkVolume(voxels, getGeometry(x, y, z), "Random volume");
+        success &= checkStreaming(voxels, getGeometry(x, y, z), "Random volume");
+    }
+
+    std::cout << (success ? "All surfaces are manifold" : "Non-manifold surfaces") << std::endl;
+    return success ? 0 : 1;
+}